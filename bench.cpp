@@ -0,0 +1,88 @@
+#include "headers/perf.h"
+#include <iostream>
+#include <string>
+#include <cstdlib>
+
+using namespace Simulation;
+
+// usage:
+//      bench [--full] [--repeat n] [--budget seconds] [--baseline path] [--local path] [--tolerance t] [--update]
+// runs the benchmark grid (see perfGrid), writes data/bench/results.csv and data/bench/report.csv, and compares the run against the baseline
+//      the shared baseline (tracked in git) holds only the ticks and peak bytes, which are the same on every machine
+//      wall and export times are compared against the local baseline, which stays on the machine that recorded it (untracked)
+//      --full          10 to 10^6 processes on 1 to 1024 CPUs (10^5 and up need -DSIMULATION_SCALE), instead of the quick grid
+//      --repeat n      time each case n times and keep the fastest (default 3)
+//      --budget s      skip a case predicted to take longer than s seconds (default 120, 0 runs everything)
+//      --baseline p    the shared baseline (default data/bench/baseline.csv)
+//      --local p       the local baseline with times (default data/bench/baseline.local.csv)
+//      --tolerance t   flag wall and export times more than t slower or faster (default 0.25)
+//      --update        store this run as both baselines
+// exits with 2 if a case regressed against the baseline
+int main(int argc, char** argv) {
+    bool full = false, update = false;
+    unsigned repeat = 3;
+    double budget = 120, tolerance = 0.25;
+    std::string folder = DATA_DIR + "/bench";
+    std::string baseline = folder + "/baseline.csv";
+    std::string local = folder + "/baseline.local.csv";
+    try {
+        for(int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            bool has_value = i + 1 < argc;
+            if(arg == "--full")
+                full = true;
+            else if(arg == "--update")
+                update = true;
+            else if(arg == "--repeat" && has_value)
+                repeat = std::stoul(argv[++i]);
+            else if(arg == "--budget" && has_value)
+                budget = std::stod(argv[++i]);
+            else if(arg == "--baseline" && has_value)
+                baseline = argv[++i];
+            else if(arg == "--local" && has_value)
+                local = argv[++i];
+            else if(arg == "--tolerance" && has_value)
+                tolerance = std::stod(argv[++i]);
+            else {
+                std::cerr << "usage: " << argv[0] << " [--full] [--repeat n] [--budget seconds] [--baseline path] [--local path] [--tolerance t] [--update]" << std::endl;
+                return 1;
+            }
+        }
+
+        std::vector<PerfResult> results = runPerf(perfGrid(full), repeat, folder, budget);
+        writePerfResults(folder + "/results.csv", results);
+
+        std::vector<PerfResult> shared, timed;
+        if(access(baseline.c_str(), R_OK) == 0)
+            shared = readPerfResults(baseline);
+        else
+            std::cout << "no baseline at " << baseline << std::endl;
+        if(access(local.c_str(), R_OK) == 0)
+            timed = readPerfResults(local);
+        else
+            std::cout << "no local baseline at " << local << ", times are not compared" << std::endl;
+        PerfReport report = comparePerf(results, mergeBaselines(shared, timed), tolerance);
+        report.print();
+        std::string path = folder + "/report.csv";
+        std::ofstream f(path, std::ofstream::out);
+        if(!f.is_open())
+            throw "Error opening file " + path;
+        f << PerfReport::to_csv_header() << std::endl << report.to_csv();
+
+        if(update) {
+            writePerfResults(baseline, results, false);
+            writePerfResults(local, results);
+            std::cout << "baseline stored in " << baseline << " and " << local << std::endl;
+        }
+        return report.regressed() ? 2 : 0;
+    } catch(std::string e) {
+        std::cerr << e << std::endl;
+        return 1;
+    } catch(const char* e) {
+        std::cerr << e << std::endl;
+        return 1;
+    } catch(const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
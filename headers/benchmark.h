@@ -11,14 +11,24 @@
 #include "typedefs.h"
 #include "system.h"
 #include "stats.h"
+#include "trace.h"
+#include "results_store.h"
+#include "cache.h"
+#include "compare.h"
+#include "parallel.h"
 
 namespace Simulation {
-    SimulationStats simulate(SystemSettings sett, std::vector<ProcessPlan> data_files) {
-        System sys(sett);
+    SimulationStats simulate(SystemSettings sett, const std::vector<ProcessPlan>& data_files) {
+        System sys(sett, MemoryMode::arena);
         sys.simulate(data_files);
         return sys.outputStats();
     }
 
+    // as above, but returns the cached stats if this settings and workload were simulated before
+    SimulationStats simulate(SystemSettings sett, const std::vector<ProcessPlan>& data_files, ResultCache& cache) {
+        return cache.fetch(sett, data_files, [&sett, &data_files]() { return simulate(sett, data_files); });
+    }
+
     SimulationStats simulate(SystemSettings sett) {
         return simulate(sett, generateDataFiles(sett.PROCESS_COUNT));
     }
@@ -27,18 +37,34 @@ namespace Simulation {
         return simulate(SystemSettings());
     }
 
+    // open-system run: processes keep arriving until the horizon, stats exclude the detected warm-up
+    SteadyStateStats simulateOpen(SystemSettings sett, ArrivalProcess& arrivals, Step horizon, uint64_t seed = 0) {
+        System sys(sett, MemoryMode::arena);
+        sys.simulateOpen(arrivals, horizon, seed);
+        return sys.outputSteadyState();
+    }
+
     // simulate many runs
     // for each unique number of processes, use the same process plan
+    // all runs share one System, so every run after the first reuses the previous run's arena
+    // with a cache, runs it already holds are not simulated again
     template<class iterator_type>
-    ManyStats simulateRun(iterator_type start, iterator_type end, std::string name = "") {
+    ManyStats simulateRun(iterator_type start, iterator_type end, std::string name = "", ResultCache* cache = nullptr) {
         ManyStats stats;
         std::map<PID, std::vector<ProcessPlan>> plan_map;
+        System sys(SystemSettings(), MemoryMode::arena);
         while(start != end) {
             PID n = (*start).PROCESS_COUNT;
             // add to map if not already there
             if(plan_map.find(n) == plan_map.end())
                 plan_map[n] = generateDataFiles(n);
-            stats.runs.push_back(simulate(*(start++), plan_map[n]));
+            SystemSettings sett = *(start++);
+            auto run = [&sys, &sett, &plan_map, n]() {
+                sys.updateSettings(sett);
+                sys.simulate(plan_map[n]);
+                return sys.outputStats();
+            };
+            stats.runs.push_back(cache ? cache->fetch(sett, plan_map[n], run) : run());
         }
         if(name == "")
             name = std::to_string(time(NULL));
@@ -0,0 +1,351 @@
+// defines ResultCache, an on-disk cache of SimulationStats keyed by the settings, the workload and the engine version
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "typedefs.h"
+#include "process_utils.h"
+#include "stats.h"
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cstdio>
+#include <stdint.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <utime.h>
+
+namespace Simulation {
+    // bump whenever a change to the simulation changes the results of existing settings and workloads
+    // every entry cached by an older engine then misses
+    const uint32_t ENGINE_VERSION = 14;
+
+    // normal: return hits, store misses
+    // refresh: always simulate, then store (replacing the old entry)
+    // bypass: always simulate, never touch the cache
+    enum class CacheMode {normal, refresh, bypass};
+
+    // 64-bit FNV-1a, built up field by field
+    class Fingerprint {
+        private:
+            uint64_t h;
+        public:
+            Fingerprint() : h(1469598103934665603ull) {}
+
+            Fingerprint& add(const void* data, std::size_t n) {
+                const unsigned char* p = static_cast<const unsigned char*>(data);
+                for(std::size_t i = 0; i < n; i++)
+                    h = (h ^ p[i]) * 1099511628211ull;
+                return *this;
+            }
+            template<class T>
+            Fingerprint& add(T v) {
+                return add(&v, sizeof(T));
+            }
+            Fingerprint& add(const std::string& s) {
+                add<uint64_t>(s.size());
+                return add(s.data(), s.size());
+            }
+            uint64_t value() const {
+                return h;
+            }
+    };
+
+    // the settings are named completely by to_string (optional settings included when used)
+    // the width of Step and PID is included, since the build configurations can differ where they overflow
+    uint64_t cacheKey(const SystemSettings& sett, const std::vector<ProcessPlan>& workload) {
+        Fingerprint f;
+        f.add(ENGINE_VERSION).add<uint32_t>(sizeof(Step)).add<uint32_t>(sizeof(PID));
+        f.add(to_string(sett));
+        f.add<uint64_t>(workload.size());
+        for(auto& pl : workload) {
+            f.add(pl.arrival).add(pl.init.id).add(pl.init.prio).add(pl.init.tickets).add(pl.init.bursts.isProcessing());
+            f.add(pl.init.deadline).add(pl.init.period).add(pl.releases).add<uint64_t>(pl.init.group);
+            f.add<uint64_t>(pl.init.bursts.size());
+            for(auto it = pl.init.bursts.cbegin(); it != pl.init.bursts.cend(); it++)
+                f.add(*it);
+            // a lazy process is named by its generator's state
+            f.add(pl.init.bursts.isLazy());
+            if(pl.init.bursts.isLazy())
+                pl.init.bursts.generator()->fingerprint([&f](uint64_t x) { f.add(x); });
+        }
+        return f.value();
+    }
+
+    // a directory of entries, one file per key, holding the complete SimulationStats of a run
+    //      the total size is kept under max_bytes by evicting the least recently used entries (a hit refreshes the mtime)
+    //      the directory is scanned once on construction and then only when the running total passes max_bytes, so a miss costs O(1) filesystem calls
+    //      (entries stored by other processes are only counted at the next scan, so the cache can overrun max_bytes by what they stored)
+    //      entries are written to a temporary file and renamed, so concurrent runs never see half an entry
+    class ResultCache {
+        private:
+            std::string dir;
+            uint64_t max_bytes;
+            CacheMode mode;
+            uint64_t hits;
+            uint64_t misses;
+            uint64_t total_bytes;   // of the entries, as of the last scan plus what this cache stored since
+
+            std::string pathOf(uint64_t key) const {
+                std::ostringstream out;
+                out << dir << "/" << std::hex << std::setw(16) << std::setfill('0') << key << ".simc";
+                return out.str();
+            }
+
+            template<class T>
+            static void put(std::ostream& out, T v) {
+                out.write(reinterpret_cast<const char*>(&v), sizeof(T));
+            }
+            template<class T>
+            static T get(std::istream& in) {
+                T v;
+                if(!in.read(reinterpret_cast<char*>(&v), sizeof(T)))
+                    throw std::string("Truncated cache entry");
+                return v;
+            }
+
+            template<class E>
+            static void putHistory(std::ostream& out, const History<E>& hist) {
+                put<uint64_t>(out, hist.size());
+                for(auto& p : hist) {
+                    put<uint8_t>(out, (uint8_t)(p.state));
+                    put<Step>(out, p.duration);
+                }
+            }
+            template<class E>
+            static History<E> getHistory(std::istream& in) {
+                History<E> hist;
+                uint64_t n = get<uint64_t>(in);
+                for(uint64_t i = 0; i < n; i++) {
+                    E state = (E)(get<uint8_t>(in));
+                    hist.push(state, get<Step>(in));
+                }
+                return hist;
+            }
+
+            static void write(std::ostream& out, uint64_t key, const SimulationStats& stats) {
+                out.write("SIMC", 4);
+                put<uint32_t>(out, ENGINE_VERSION);
+                put<uint64_t>(out, key);
+                put<uint64_t>(out, stats.ps.size());
+                for(auto& p : stats.ps) {
+                    put(out, p.id);
+                    put(out, p.prio);
+                    put(out, p.tickets);
+                    put(out, p.deadline);
+                    put(out, p.period);
+                    put<uint64_t>(out, p.group);
+                    put(out, p.started);
+                    put<uint8_t>(out, p.plan.first_processing);
+                    put(out, p.plan.count);
+                    put(out, p.plan.length);
+                    put(out, p.plan.cpu_length);
+                    put(out, p.plan.max_cpu_burst);
+                    putHistory(out, p.hist);
+                    put(out, p.preemptions);
+                    put(out, p.energy);
+                }
+                put<uint64_t>(out, stats.cs.size());
+                for(auto& c : stats.cs) {
+                    put(out, c.id);
+                    put(out, c.speed);
+                    put(out, c.switches_in);
+                    put(out, c.warm_switches);
+                    put(out, c.migrations);
+                    put(out, c.preemptions);
+                    put(out, c.energy);
+                    put(out, c.slept);
+                    put(out, c.wakeups);
+                    put(out, c.frequency_changes);
+                    putHistory(out, c.hist);
+                }
+                put<uint8_t>(out, stats.memory.accounted);
+                for(std::size_t i = 0; i <= MEMORY_PART_COUNT; i++) {
+                    const AllocationCount& a = i < MEMORY_PART_COUNT ? stats.memory.parts[i] : stats.memory.total;
+                    put(out, a.allocations);
+                    put(out, a.bytes);
+                    put(out, a.peak);
+                }
+                put(out, stats.memory.stats_bytes);
+                put<uint64_t>(out, stats.gs.size());
+                for(auto& g : stats.gs) {
+                    put<uint64_t>(out, g.id);
+                    put(out, g.ran);
+                    put(out, g.throttles);
+                    put(out, g.throttled);
+                }
+            }
+
+            static SimulationStats read(std::istream& in, uint64_t key, const SystemSettings& sett) {
+                char magic[4];
+                if(!in.read(magic, 4) || std::string(magic, 4) != "SIMC" || get<uint32_t>(in) != ENGINE_VERSION || get<uint64_t>(in) != key)
+                    throw std::string("Stale cache entry");
+                std::vector<ProcessStats> ps;
+                uint64_t n = get<uint64_t>(in);
+                ps.reserve(n);
+                for(uint64_t i = 0; i < n; i++) {
+                    PID id = get<PID>(in);
+                    Priority prio = get<Priority>(in);
+                    unsigned tickets = get<unsigned>(in);
+                    Step deadline = get<Step>(in);
+                    Step period = get<Step>(in);
+                    std::size_t group = get<uint64_t>(in);
+                    Step started = get<Step>(in);
+                    std::vector<Step> none;
+                    ps.emplace_back(ProcessInit{id, prio, ProcessBursts(none.begin(), none.end()), tickets, deadline, period, group}, started);
+                    ps.back().plan.first_processing = get<uint8_t>(in);
+                    ps.back().plan.count = get<StepSum>(in);
+                    ps.back().plan.length = get<StepSum>(in);
+                    ps.back().plan.cpu_length = get<StepSum>(in);
+                    ps.back().plan.max_cpu_burst = get<Step>(in);
+                    ps.back().hist = getHistory<ProcessState>(in);
+                    ps.back().preemptions = get<StepSum>(in);
+                    ps.back().energy = get<double>(in);
+                }
+                std::vector<CPUStats> cs(get<uint64_t>(in));
+                for(auto& c : cs) {
+                    c.id = get<CPUID>(in);
+                    c.speed = get<unsigned>(in);
+                    c.switches_in = get<StepSum>(in);
+                    c.warm_switches = get<StepSum>(in);
+                    c.migrations = get<StepSum>(in);
+                    c.preemptions = get<StepSum>(in);
+                    c.energy = get<double>(in);
+                    c.slept = get<StepSum>(in);
+                    c.wakeups = get<StepSum>(in);
+                    c.frequency_changes = get<StepSum>(in);
+                    c.hist = getHistory<CPUState>(in);
+                }
+                SimulationStats out(sett, ps.begin(), ps.end(), cs.begin(), cs.end());
+                out.memory.accounted = get<uint8_t>(in);
+                for(std::size_t i = 0; i <= MEMORY_PART_COUNT; i++) {
+                    AllocationCount& a = i < MEMORY_PART_COUNT ? out.memory.parts[i] : out.memory.total;
+                    a.allocations = get<uint64_t>(in);
+                    a.bytes = get<uint64_t>(in);
+                    a.peak = get<uint64_t>(in);
+                }
+                out.memory.stats_bytes = get<uint64_t>(in);
+                out.gs.resize(get<uint64_t>(in));
+                for(auto& g : out.gs) {
+                    g.id = get<uint64_t>(in);
+                    g.ran = get<StepSum>(in);
+                    g.throttles = get<StepSum>(in);
+                    g.throttled = get<StepSum>(in);
+                }
+                return out;
+            }
+
+            // rescans the directory, then removes the least recently used entries until the total fits
+            void evict() {
+                struct Entry {
+                    std::string path;
+                    uint64_t used;      // mtime in ns
+                    uint64_t bytes;
+                };
+                std::vector<Entry> entries;
+                uint64_t total = 0;
+                total_bytes = 0;
+                DIR* d = opendir(dir.c_str());
+                if(!d)
+                    return;
+                while(dirent* e = readdir(d)) {
+                    std::string name = e->d_name;
+                    if(name.size() < 5 || name.substr(name.size() - 5) != ".simc")
+                        continue;
+                    struct stat st;
+                    std::string path = dir + "/" + name;
+                    if(stat(path.c_str(), &st) == 0) {
+                        entries.push_back({path, (uint64_t)(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec, (uint64_t)(st.st_size)});
+                        total += st.st_size;
+                    }
+                }
+                closedir(d);
+                std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.used < b.used; });
+                for(auto& e : entries) {
+                    if(total <= max_bytes)
+                        break;
+                    unlink(e.path.c_str());
+                    total -= e.bytes;
+                }
+                total_bytes = total;
+            }
+        public:
+            static constexpr uint64_t DEFAULT_MAX_BYTES = uint64_t(1) << 30;
+
+            ResultCache(std::string dd = DATA_DIR + "/.cache", uint64_t max = DEFAULT_MAX_BYTES, CacheMode mm = CacheMode::normal) :
+                dir(dd), max_bytes(max), mode(mm), hits(0), misses(0), total_bytes(0) {
+                std::string cmd = "mkdir -p " + dir;
+                system(cmd.c_str());
+                evict();
+            }
+
+            void setMode(CacheMode mm) {
+                mode = mm;
+            }
+            CacheMode getMode() const {
+                return mode;
+            }
+            uint64_t getHits() const {
+                return hits;
+            }
+            uint64_t getMisses() const {
+                return misses;
+            }
+
+            // the stored stats for this settings and workload, or run(), stored for next time
+            template<class Simulate>
+            SimulationStats fetch(const SystemSettings& sett, const std::vector<ProcessPlan>& workload, Simulate run) {
+                if(mode == CacheMode::bypass)
+                    return run();
+                uint64_t key = cacheKey(sett, workload);
+                std::string path = pathOf(key);
+                if(mode == CacheMode::normal) {
+                    std::ifstream in(path, std::ifstream::binary);
+                    if(in.is_open()) {
+                        try {
+                            SimulationStats out = read(in, key, sett);
+                            hits++;
+                            utime(path.c_str(), nullptr);
+                            return out;
+                        } catch(std::string) {
+                            // unreadable entries are simply recomputed
+                        }
+                    }
+                }
+                misses++;
+                SimulationStats out = run();
+                std::string tmp = path + "." + std::to_string(getpid()) + ".tmp";
+                uint64_t bytes;
+                {
+                    std::ofstream f(tmp, std::ofstream::out | std::ofstream::binary);
+                    if(!f.is_open())
+                        throw "Error opening file " + tmp;
+                    write(f, key, out);
+                    bytes = f.tellp();
+                }
+                // an entry being replaced (refreshed or unreadable) no longer counts
+                struct stat st;
+                if(stat(path.c_str(), &st) == 0)
+                    total_bytes -= std::min<uint64_t>(total_bytes, st.st_size);
+                std::rename(tmp.c_str(), path.c_str());
+                total_bytes += bytes;
+                if(total_bytes > max_bytes)
+                    evict();
+                return out;
+            }
+
+            // removes every entry
+            void clear() {
+                uint64_t keep = max_bytes;
+                max_bytes = 0;
+                evict();
+                max_bytes = keep;
+            }
+    };
+}
+
+#endif
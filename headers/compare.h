@@ -0,0 +1,232 @@
+// defines Comparison, a paired comparison of several settings run on common random numbers
+
+#ifndef COMPARE_H
+#define COMPARE_H
+
+#include "typedefs.h"
+#include "system.h"
+#include "stats.h"
+#include "workload.h"
+#include "cache.h"
+#include <vector>
+#include <map>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <cmath>
+#include <limits>
+#include <stdint.h>
+
+namespace Simulation {
+    // two-sided 95% quantile of Student's t with df degrees of freedom
+    //      tabulated up to 30, then the Cornish-Fisher expansion around the normal quantile
+    double tQuantile95(std::size_t df) {
+        static const double table[] = {
+            12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+            2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+            2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+        };
+        if(df == 0)
+            return std::numeric_limits<double>::infinity();
+        if(df <= 30)
+            return table[df - 1];
+        double z = 1.959964, v = df;
+        return z + (z*z*z + z) / (4*v) + (5*std::pow(z, 5) + 16*z*z*z + 3*z) / (96*v*v);
+    }
+
+    // several settings, each run on the same workloads (common random numbers)
+    //      replication r uses the workload of seed first_seed + r for every setting, so differences between settings are not swamped by differences between workloads
+    //      with antithetic, each replication also runs the mirrored workload of its seed and records the mean of the two
+    // a metric's difference between two settings is then estimated from the per-replication differences (a paired t interval)
+    struct Comparison {
+        struct Metric {
+            std::string name;
+            double (SimulationStats::*get)() const;
+        };
+        static const std::vector<Metric>& metrics() {
+            static const std::vector<Metric> out = {
+                {"Avg Turnaround", &SimulationStats::getAvgTurnaround},
+                {"Avg Wait", &SimulationStats::getAvgWait},
+                {"Avg Response", &SimulationStats::getAvgResponse},
+                {"Throughput", &SimulationStats::getThroughput},
+                {"Energy per Process", &SimulationStats::getEnergyPerProcess}
+            };
+            return out;
+        }
+
+        // settings[b] minus settings[a] for one metric, over the replications
+        struct Difference {
+            std::size_t metric;
+            std::size_t a;
+            std::size_t b;
+            std::size_t n;
+            double mean;
+            double half_width;          // 95% paired t interval
+            double unpaired_half_width; // the interval the same number of independent replications would give
+
+            double getLow() const {
+                return mean - half_width;
+            }
+            double getHigh() const {
+                return mean + half_width;
+            }
+            // the interval excludes 0
+            bool significant() const {
+                return std::abs(mean) > half_width;
+            }
+            // how many times as many replications independent workloads would need for an interval this narrow
+            double getRunsSaved() const {
+                return half_width == 0 ? std::numeric_limits<double>::infinity() : std::pow(unpaired_half_width / half_width, 2);
+            }
+        };
+
+        std::string name;
+        std::vector<SystemSettings> settings;
+        std::vector<uint64_t> seeds;
+        bool antithetic = false;
+        // values[metric][setting][replication]
+        std::vector<std::vector<std::vector<double>>> values;
+
+        std::size_t replications() const {
+            return seeds.size();
+        }
+
+        Difference difference(std::size_t metric, std::size_t a, std::size_t b) const {
+            const std::vector<double>& va = values[metric][a];
+            const std::vector<double>& vb = values[metric][b];
+            std::size_t n = va.size();
+            double sum = 0, sum_a = 0, sum_b = 0;
+            for(std::size_t r = 0; r < n; r++) {
+                sum += vb[r] - va[r];
+                sum_a += va[r];
+                sum_b += vb[r];
+            }
+            double mean = n == 0 ? 0 : sum / n;
+            if(n < 2)
+                return {metric, a, b, n, mean, std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity()};
+            double var = 0, var_a = 0, var_b = 0;
+            for(std::size_t r = 0; r < n; r++) {
+                var += std::pow(vb[r] - va[r] - mean, 2);
+                var_a += std::pow(va[r] - sum_a / n, 2);
+                var_b += std::pow(vb[r] - sum_b / n, 2);
+            }
+            double t = tQuantile95(n - 1);
+            return {metric, a, b, n, mean, t * std::sqrt(var / (n - 1) / n), t * std::sqrt((var_a + var_b) / (n - 1) / n)};
+        }
+        // every metric of every setting against settings[0]
+        std::vector<Difference> differences() const {
+            std::vector<Difference> out;
+            for(std::size_t b = 1; b < settings.size(); b++)
+                for(std::size_t m = 0; m < metrics().size(); m++)
+                    out.push_back(difference(m, 0, b));
+            return out;
+        }
+
+        void print() const {
+            std::cout << std::setprecision(5) << std::endl << "Paired Comparison (" << replications() << " replications"
+                << (antithetic ? ", antithetic" : "") << "):" << std::endl;
+            std::cout << "    Baseline: " << to_string(settings.front()) << std::endl;
+            for(std::size_t b = 1; b < settings.size(); b++) {
+                std::cout << "    " << to_string(settings[b]) << " minus baseline:" << std::endl;
+                for(std::size_t m = 0; m < metrics().size(); m++) {
+                    Difference d = difference(m, 0, b);
+                    std::cout << "        " << std::left << std::setw(20) << metrics()[m].name + ":" << std::right
+                        << d.mean << " +- " << d.half_width << (d.significant() ? " *" : "")
+                        << " (independent: +- " << d.unpaired_half_width << ", " << d.getRunsSaved() << "x the runs)" << std::endl;
+                }
+            }
+            std::cout << "    (* the 95% interval excludes 0)" << std::endl << std::endl;
+        }
+
+        static std::string to_csv_header() {
+            return "Baseline,Settings,Metric,Replications,Antithetic,Difference,Low,High,Significant,Independent Half Width,Runs Saved";
+        }
+        std::string to_csv() const {
+            std::ostringstream out;
+            out << std::setprecision(6);
+            for(auto& d : differences())
+                out << to_string(settings[d.a]) << "," << to_string(settings[d.b]) << "," << metrics()[d.metric].name << ","
+                    << d.n << "," << antithetic << "," << d.mean << "," << d.getLow() << "," << d.getHigh() << ","
+                    << d.significant() << "," << d.unpaired_half_width << "," << d.getRunsSaved() << std::endl;
+            return out.str();
+        }
+
+        std::string getFolderName() const {
+            return DATA_DIR + "/" + name;
+        }
+
+        // comparison.csv holds the differences, replications.csv every setting's metrics per replication
+        void exportStats() const {
+            std::string folder = getFolderName();
+            std::string cmd = "mkdir -p " + folder;
+            system(cmd.c_str());
+
+            std::ofstream comp(folder + "/comparison.csv", std::ofstream::out);
+            if(!comp.is_open())
+                throw "Error opening file " + folder + "/comparison.csv";
+            comp << to_csv_header() << std::endl << to_csv();
+
+            std::ofstream reps(folder + "/replications.csv", std::ofstream::out);
+            if(!reps.is_open())
+                throw "Error opening file " + folder + "/replications.csv";
+            reps << "Settings,Seed";
+            for(auto& m : metrics())
+                reps << "," << m.name;
+            reps << std::endl << std::setprecision(6);
+            for(std::size_t i = 0; i < settings.size(); i++)
+                for(std::size_t r = 0; r < replications(); r++) {
+                    reps << to_string(settings[i]) << "," << seeds[r];
+                    for(std::size_t m = 0; m < metrics().size(); m++)
+                        reps << "," << values[m][i][r];
+                    reps << std::endl;
+                }
+        }
+    };
+
+    // runs every setting on the workloads of seeds first_seed .. first_seed + replications - 1 (see Comparison)
+    // the workloads come from generateDataFiles(n, seed), so they do not depend on rand() or on the other settings compared
+    // the lottery draws come from the seed as well (LOTTERY_SEED), so they are common to the settings of a replication but differ between replications
+    // with a cache, runs it already holds are not simulated again
+    Comparison compareSettings(const std::vector<SystemSettings>& setts, std::size_t replications, uint64_t first_seed = 1, bool antithetic = false, std::string name = "", ResultCache* cache = nullptr) {
+        Comparison out;
+        out.name = name == "" ? std::to_string(time(NULL)) : name;
+        out.settings = setts;
+        out.antithetic = antithetic;
+        out.values.assign(Comparison::metrics().size(), std::vector<std::vector<double>>(setts.size()));
+
+        System sys(SystemSettings(), MemoryMode::arena);
+        for(std::size_t r = 0; r < replications; r++) {
+            uint64_t seed = first_seed + r;
+            out.seeds.push_back(seed);
+            // one workload (or antithetic pair) per process count, shared by every setting
+            std::map<PID, std::vector<std::vector<ProcessPlan>>> plan_map;
+            for(std::size_t i = 0; i < setts.size(); i++) {
+                SystemSettings sett = setts[i];
+                sett.LOTTERY_SEED = seed;
+                auto& plans = plan_map[sett.PROCESS_COUNT];
+                if(plans.empty()) {
+                    plans.push_back(generateDataFiles(sett.PROCESS_COUNT, seed));
+                    if(antithetic)
+                        plans.push_back(generateDataFiles(sett.PROCESS_COUNT, seed, true));
+                }
+                std::vector<double> sums(Comparison::metrics().size(), 0);
+                for(auto& plan : plans) {
+                    auto run = [&sys, &sett, &plan]() {
+                        sys.updateSettings(sett);
+                        sys.simulate(plan);
+                        return sys.outputStats();
+                    };
+                    SimulationStats stats = cache ? cache->fetch(sett, plan, run) : run();
+                    for(std::size_t m = 0; m < sums.size(); m++)
+                        sums[m] += (stats.*(Comparison::metrics()[m].get))();
+                }
+                for(std::size_t m = 0; m < sums.size(); m++)
+                    out.values[m][i].push_back(sums[m] / plans.size());
+            }
+        }
+        return out;
+    }
+}
+
+#endif
@@ -0,0 +1,91 @@
+// defines the trace and invariant layer of the System: scheduling events sent to a TraceSink, and consistency checks after every step
+
+#ifndef DEBUG_H
+#define DEBUG_H
+
+#include "typedefs.h"
+#include <vector>
+#include <string>
+#include <iostream>
+#include <limits>
+
+// the level is picked at compile time (build with -DSIMULATION_TRACE_LEVEL=1 or 2)
+//  0: nothing is traced or checked, every call site is discarded by if constexpr, so release sweeps pay nothing
+//  1: scheduling events are sent to the System's TraceSink (see System::setTraceSink)
+//  2: as 1, and the System checks its invariants after every step (O(processes + CPUs) per step), throwing on the first violation
+#ifndef SIMULATION_TRACE_LEVEL
+#define SIMULATION_TRACE_LEVEL 0
+#endif
+
+namespace Simulation {
+    constexpr int TRACE_LEVEL = SIMULATION_TRACE_LEVEL;
+
+    // arrive: the process was created
+    // ready/block: the process joined the ready queue/started an IO burst (the event's step is the first one it counts in that state)
+    // dispatch: a CPU took the process and starts switching it in
+    // preempt: a CPU started switching the process out for a higher-priority one
+    // switched_out: the CPU finished switching the process out (it then moves to ready, block or retire)
+    // retire: the process finished
+    enum class TraceKind {arrive, ready, block, dispatch, preempt, switched_out, retire};
+    std::string to_string(TraceKind k) {
+        switch(k) {
+            case TraceKind::arrive:
+                return "arrive";
+            case TraceKind::ready:
+                return "ready";
+            case TraceKind::block:
+                return "block";
+            case TraceKind::dispatch:
+                return "dispatch";
+            case TraceKind::preempt:
+                return "preempt";
+            case TraceKind::switched_out:
+                return "switched_out";
+            case TraceKind::retire:
+                return "retire";
+        }
+        return "";
+    }
+
+    struct TraceEvent {
+        static constexpr CPUID NO_CPU = std::numeric_limits<CPUID>::max();
+
+        Step step;
+        TraceKind kind;
+        PID id;
+        CPUID cpu;      // NO_CPU for events which happen off the CPUs
+    };
+
+    class TraceSink {
+        public:
+            virtual ~TraceSink() {}
+            virtual void event(const TraceEvent& e) = 0;
+    };
+
+    // one line per event, e.g. "1042 dispatch 17 cpu 3"
+    class StreamTraceSink : public TraceSink {
+        private:
+            std::ostream& out;
+        public:
+            StreamTraceSink(std::ostream& oo = std::cerr) : out(oo) {}
+
+            void event(const TraceEvent& e) override {
+                out << e.step << " " << to_string(e.kind) << " " << e.id;
+                if(e.cpu != TraceEvent::NO_CPU)
+                    out << " cpu " << e.cpu;
+                out << "\n";
+            }
+    };
+
+    // keeps every event, for inspection after the run
+    class TraceLog : public TraceSink {
+        public:
+            std::vector<TraceEvent> events;
+
+            void event(const TraceEvent& e) override {
+                events.push_back(e);
+            }
+    };
+}
+
+#endif
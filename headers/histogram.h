@@ -0,0 +1,102 @@
+// defines LatencyHistogram, a log-bucketed (HDR-style) histogram for latency percentiles
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include "typedefs.h"
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdint.h>
+
+namespace Simulation {
+    // values below SUB_BUCKETS are counted exactly
+    // above that, every power of two is split into SUB_BUCKETS/2 linear sub-buckets, bounding the relative error by 2/SUB_BUCKETS (about 6%)
+    // so the memory is fixed by the range of values (about 1000 counters for the whole of uint64_t) rather than the number recorded
+    // resolution is the unit of a counted value, e.g. 0.001 to keep three decimals of a ratio
+    class LatencyHistogram {
+        public:
+            static constexpr unsigned PRECISION_BITS = 5;
+            static constexpr uint64_t SUB_BUCKETS = uint64_t(1) << PRECISION_BITS;
+        private:
+            double resolution;
+            std::vector<uint64_t> counts;     // grown up to the highest bucket seen
+            uint64_t total;
+            uint64_t min_v;
+            uint64_t max_v;
+            double sum;
+
+            static std::size_t indexOf(uint64_t v) {
+                if(v < SUB_BUCKETS)
+                    return v;
+                unsigned msb = 63 - __builtin_clzll(v);
+                unsigned mag = msb - (PRECISION_BITS - 1);
+                return mag * (SUB_BUCKETS / 2) + (v >> mag);
+            }
+            // largest value counted in bucket i
+            static uint64_t highestOf(std::size_t i) {
+                if(i < SUB_BUCKETS)
+                    return i;
+                unsigned mag = i / (SUB_BUCKETS / 2) - 1;
+                uint64_t sub = i - mag * (SUB_BUCKETS / 2);
+                return ((sub + 1) << mag) - 1;
+            }
+        public:
+            LatencyHistogram(double res = 1) : resolution(res), total(0), min_v(std::numeric_limits<uint64_t>::max()), max_v(0), sum(0) {}
+
+            void record(double value) {
+                uint64_t v = value <= 0 ? 0 : std::llround(value / resolution);
+                std::size_t i = indexOf(v);
+                if(i >= counts.size())
+                    counts.resize(i + 1, 0);
+                counts[i]++;
+                total++;
+                min_v = std::min(min_v, v);
+                max_v = std::max(max_v, v);
+                sum += v;
+            }
+
+            // adds other's counts (the resolutions must match)
+            LatencyHistogram& merge(const LatencyHistogram& other) {
+                if(other.counts.size() > counts.size())
+                    counts.resize(other.counts.size(), 0);
+                for(std::size_t i = 0; i < other.counts.size(); i++)
+                    counts[i] += other.counts[i];
+                total += other.total;
+                min_v = std::min(min_v, other.min_v);
+                max_v = std::max(max_v, other.max_v);
+                sum += other.sum;
+                return *this;
+            }
+
+            uint64_t count() const {
+                return total;
+            }
+            double getMin() const {
+                return total == 0 ? 0 : min_v * resolution;
+            }
+            double getMax() const {
+                return max_v * resolution;
+            }
+            double getMean() const {
+                return total == 0 ? 0 : sum / total * resolution;
+            }
+
+            // smallest recorded value v such that at least p% of values are <= v (to within the bucket precision)
+            double percentile(double p) const {
+                if(total == 0)
+                    return 0;
+                uint64_t rank = std::max<uint64_t>(1, std::ceil(p / 100.0 * total));
+                uint64_t seen = 0;
+                for(std::size_t i = 0; i < counts.size(); i++) {
+                    seen += counts[i];
+                    if(seen >= rank)
+                        return std::min(highestOf(i), max_v) * resolution;
+                }
+                return max_v * resolution;
+            }
+    };
+}
+
+#endif
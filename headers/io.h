@@ -0,0 +1,107 @@
+// defines the IODevice class which serves IO bursts with a finite number of channels
+
+#ifndef IO_H
+#define IO_H
+
+#include "typedefs.h"
+#include <vector>
+#include <queue>
+#include <functional>
+#include <string>
+#include <stdint.h>
+
+namespace Simulation {
+    // an IO burst waiting for, or being served by, a device
+    struct IORequest {
+        PID id;
+        Step length;    // steps of service required
+        Step since;     // first step the request could have been served
+        Priority prio;
+    };
+
+    // a completion scheduled by a device
+    // System keeps these in one heap across all devices, so only devices with a finishing request cost anything on a given step
+    struct IOEvent {
+        Step finish;        // step on which the last step of service happens
+        uint64_t seq;       // breaks ties in the order service started
+        CPUID device;
+        IORequest req;
+        Step waited;        // steps spent queued before service started
+
+        friend bool operator>(const IOEvent& a, const IOEvent& b) {
+            return a.finish != b.finish ? a.finish > b.finish : a.seq > b.seq;
+        }
+    };
+    using IOEventQueue = std::priority_queue<IOEvent, std::vector<IOEvent>, std::greater<IOEvent>>;
+
+    // a device with some number of channels, each serving one request at a time
+    // requests beyond the free channels wait in a queue ordered by the device's discipline
+    class IODevice {
+        private:
+            struct Waiting {
+                StepSum key;
+                uint64_t seq;
+                IORequest req;
+
+                friend bool operator>(const Waiting& a, const Waiting& b) {
+                    return a.key != b.key ? a.key > b.key : a.seq > b.seq;
+                }
+            };
+
+            CPUID id;
+            IODeviceSettings settings;
+            unsigned busy;
+            std::priority_queue<Waiting, std::vector<Waiting>, std::greater<Waiting>> waiting;
+            uint64_t arrivals;
+
+            StepSum keyOf(const IORequest& req) const {
+                switch(settings.discipline) {
+                    case IODiscipline::fifo:
+                        return 0;
+                    case IODiscipline::sjf:
+                        return req.length;
+                    case IODiscipline::priority:
+                        return req.prio;
+                }
+                return 0;
+            }
+
+            void start(const IORequest& req, Step s, IOEventQueue& events, uint64_t& seq) {
+                busy++;
+                events.push({s + req.length - 1, seq++, id, req, s - req.since});
+            }
+        public:
+            IODevice(CPUID dd, IODeviceSettings sett) : id(dd), settings(sett), busy(0), arrivals(0) {
+                // a device without channels never serves anything, so the run would never finish
+                if(sett.channels == 0)
+                    throw "IO device " + std::to_string(dd) + " needs at least one channel";
+            }
+
+            // number of requests queued or in service
+            std::size_t load() const {
+                return busy + waiting.size();
+            }
+
+            // a new request, served immediately if a channel is free
+            void submit(const IORequest& req, IOEventQueue& events, uint64_t& seq) {
+                if(busy < settings.channels)
+                    start(req, req.since, events, seq);
+                else
+                    waiting.push({keyOf(req), arrivals, req});
+                arrivals++;
+            }
+
+            // a channel finished serving a request on step s
+            // the next waiting request (if any) starts on the following step
+            void complete(Step s, IOEventQueue& events, uint64_t& seq) {
+                busy--;
+                if(!waiting.empty()) {
+                    IORequest req = waiting.top().req;
+                    waiting.pop();
+                    start(req, s + 1, events, seq);
+                }
+            }
+    };
+}
+
+#endif
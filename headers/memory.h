@@ -0,0 +1,193 @@
+// defines the memory resources used to scope the allocations of a single simulation
+
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <memory_resource>
+#include <memory>
+#include <optional>
+#include <array>
+#include <algorithm>
+#include <string>
+#include <cstddef>
+#include <stdint.h>
+
+namespace Simulation {
+    // heap: every container allocates through the global heap (the default resource)
+    // arena: every container of a System allocates from that System's SimulationArena
+    enum class MemoryMode {heap, arena};
+
+    // passes every request through to an upstream resource and remembers how many bytes it handed out
+    class CountingResource : public std::pmr::memory_resource {
+        private:
+            std::pmr::memory_resource* upstream;
+            std::size_t total;
+        protected:
+            void* do_allocate(std::size_t bytes, std::size_t align) override {
+                total += bytes;
+                return upstream->allocate(bytes, align);
+            }
+            void do_deallocate(void* p, std::size_t bytes, std::size_t align) override {
+                upstream->deallocate(p, bytes, align);
+            }
+            bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+                return this == &other;
+            }
+        public:
+            CountingResource(std::pmr::memory_resource* up = std::pmr::new_delete_resource()) : upstream(up), total(0) {}
+
+            std::size_t bytesAllocated() const {
+                return total;
+            }
+            void resetCount() {
+                total = 0;
+            }
+    };
+
+    // the parts of a System whose allocations are accounted separately (see SystemSettings::MEMORY_ACCOUNTING)
+    // live_processes: the PCB table, with the bursts and History of every process still running
+    // retired: finished PCBs kept until the stats are output
+    // queues: the ready queue, the blocked list and the arrival order
+    // cpu_histories: the History of every CPU
+    enum class MemoryPart {live_processes, retired, queues, cpu_histories};
+    constexpr std::size_t MEMORY_PART_COUNT = 4;
+    std::string to_string(MemoryPart m) {
+        switch(m) {
+            case MemoryPart::live_processes:
+                return "live_processes";
+            case MemoryPart::retired:
+                return "retired";
+            case MemoryPart::queues:
+                return "queues";
+            case MemoryPart::cpu_histories:
+                return "cpu_histories";
+        }
+        return "";
+    }
+
+    struct AllocationCount {
+        uint64_t allocations = 0;
+        uint64_t bytes = 0;     // over every allocation
+        uint64_t live = 0;      // bytes currently held
+        uint64_t peak = 0;      // most bytes held at once
+
+        void allocate(std::size_t n) {
+            allocations++;
+            bytes += n;
+            live += n;
+            peak = std::max(peak, live);
+        }
+        void deallocate(std::size_t n) {
+            live -= n;
+        }
+    };
+
+    // what one run allocated, per MemoryPart and in total (the total's peak is the most held at once over every part)
+    struct MemoryFootprint {
+        bool accounted = false;
+        std::array<AllocationCount, MEMORY_PART_COUNT> parts;
+        AllocationCount total;
+        uint64_t stats_bytes = 0;       // approximate size of the SimulationStats output
+
+        const AllocationCount& operator[](MemoryPart m) const {
+            return parts[static_cast<std::size_t>(m)];
+        }
+    };
+
+    // passes every request through to an upstream resource, counting it in its own count and in a shared total while enabled
+    class TrackingResource : public std::pmr::memory_resource {
+        private:
+            std::pmr::memory_resource* upstream;
+            AllocationCount* total;
+            AllocationCount count;
+            bool enabled;
+        protected:
+            void* do_allocate(std::size_t bytes, std::size_t align) override {
+                if(enabled) {
+                    count.allocate(bytes);
+                    total->allocate(bytes);
+                }
+                return upstream->allocate(bytes, align);
+            }
+            void do_deallocate(void* p, std::size_t bytes, std::size_t align) override {
+                if(enabled) {
+                    count.deallocate(bytes);
+                    total->deallocate(bytes);
+                }
+                upstream->deallocate(p, bytes, align);
+            }
+            bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+                return this == &other;
+            }
+        public:
+            TrackingResource(std::pmr::memory_resource* up, AllocationCount* tt) : upstream(up), total(tt), enabled(false) {}
+
+            const AllocationCount& getCount() const {
+                return count;
+            }
+            // counting starts afresh (only call while nothing allocated through this resource is held)
+            void enable(bool on) {
+                enabled = on;
+                count = AllocationCount();
+            }
+    };
+
+    // an arena which serves every allocation of one simulation
+    //      small blocks are recycled by an unsynchronized pool (one arena per System, so no locking)
+    //      the pool carves its chunks out of a monotonic buffer which is released in bulk by reset()
+    //      the buffer grows to the high-water mark of previous runs, so the next run of a sweep reuses it
+    class SimulationArena : public std::pmr::memory_resource {
+        private:
+            std::unique_ptr<std::byte[]> buffer;
+            std::size_t buffer_size;
+            CountingResource overflow;      // everything the monotonic buffer had to request beyond buffer
+            std::optional<std::pmr::monotonic_buffer_resource> mono;
+            std::optional<std::pmr::unsynchronized_pool_resource> pool;
+
+            void build() {
+                if(buffer_size > 0)
+                    mono.emplace(buffer.get(), buffer_size, &overflow);
+                else
+                    mono.emplace(&overflow);
+                pool.emplace(&*mono);
+            }
+        protected:
+            void* do_allocate(std::size_t bytes, std::size_t align) override {
+                return pool->allocate(bytes, align);
+            }
+            void do_deallocate(void* p, std::size_t bytes, std::size_t align) override {
+                pool->deallocate(p, bytes, align);
+            }
+            bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+                return this == &other;
+            }
+        public:
+            SimulationArena() : buffer_size(0) {
+                build();
+            }
+            SimulationArena(const SimulationArena&) = delete;
+            SimulationArena& operator=(const SimulationArena&) = delete;
+
+            // size of the reusable buffer backing the arena
+            std::size_t capacity() const {
+                return buffer_size;
+            }
+
+            // frees everything allocated since the last reset
+            // NOTE: every container using this arena must already be empty (or destroyed)
+            void reset() {
+                std::size_t needed = buffer_size + overflow.bytesAllocated();
+                pool.reset();
+                mono.reset();
+                // grow the buffer so the next run of the same size never leaves it
+                if(needed > buffer_size) {
+                    buffer.reset(new std::byte[needed]);
+                    buffer_size = needed;
+                }
+                overflow.resetCount();
+                build();
+            }
+    };
+}
+
+#endif
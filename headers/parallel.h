@@ -0,0 +1,234 @@
+// defines ParallelSystem, which splits the CPUs and processes of one run into clusters stepped on separate threads
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "typedefs.h"
+#include "system.h"
+#include "stats.h"
+#include "workload.h"
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <algorithm>
+#include <limits>
+
+namespace Simulation {
+    // a reusable barrier whose last arrival runs done() before anyone is released
+    class WindowBarrier {
+        private:
+            std::mutex m;
+            std::condition_variable cv;
+            std::size_t count;
+            std::size_t waiting;
+            uint64_t generation;
+        public:
+            WindowBarrier(std::size_t cc) : count(cc), waiting(0), generation(0) {}
+
+            template<class F>
+            void arrive(F done) {
+                std::unique_lock<std::mutex> lock(m);
+                uint64_t gen = generation;
+                if(++waiting == count) {
+                    done();
+                    waiting = 0;
+                    generation++;
+                    cv.notify_all();
+                } else {
+                    cv.wait(lock, [this, gen]() { return generation != gen; });
+                }
+            }
+    };
+
+    // one run split into clusters, each a System with its share of the CPUs and of the processes (plan i goes to cluster i % clusters)
+    //      the clusters are stepped in windows, each cluster by one thread, without touching each other within a window
+    //      at the barrier between windows, clusters with more ready processes than idle CPUs pass the surplus to clusters with idle CPUs
+    //      a window lasts SWITCHING_IN_MIGRATION_DELAY steps (the lookahead), so a surplus process can wait up to a whole window
+    //      for the next barrier before it moves, and then switches in with the migration delay on top
+    //      a migrant joins its new cluster's ready queue as of the barrier, behind the processes already waiting there
+    // the results depend on the number of clusters but never on the number of threads
+    //      each cluster's steps within a window depend only on that cluster, and the migrations are decided by one thread, in cluster order
+    // NOTE: each cluster has its own IO devices and its own copy of the fair scheduler's groups (so quotas hold per cluster), and telemetry and the open system are not supported
+    class ParallelSystem {
+        private:
+            SystemSettings settings;
+            std::vector<std::unique_ptr<System>> clusters;
+            std::vector<std::vector<ProcessPlan>> plans;    // of each cluster, kept for the run
+            std::vector<Step> next;                         // next step of each cluster
+            std::size_t threads;
+            Step window;
+            StepSum migrations;
+
+            // steps cluster c up to (not including) end, stopping early once it has finished
+            void advance(std::size_t c, Step end) {
+                while(next[c] < end && !clusters[c]->finished())
+                    clusters[c]->tick(next[c]++);
+            }
+            // steps an idle cluster up to end
+            void pad(std::size_t c, Step end) {
+                while(next[c] < end)
+                    clusters[c]->tick(next[c]++);
+            }
+
+            // moves ready processes from the cluster with the most surplus to the one with the most idle CPUs, one at a time
+            void balance(Step barrier) {
+                std::vector<long long> surplus(clusters.size());
+                for(std::size_t c = 0; c < clusters.size(); c++)
+                    surplus[c] = (long long)(clusters[c]->readyProcesses()) - clusters[c]->idleCPUs();
+                for(;;) {
+                    auto src = std::max_element(surplus.begin(), surplus.end());
+                    auto dst = std::min_element(surplus.begin(), surplus.end());
+                    if(*src <= 0 || *dst >= 0)
+                        break;
+                    std::size_t from = src - surplus.begin(), to = dst - surplus.begin();
+                    // a finished cluster stopped stepping, so it catches up first
+                    pad(to, barrier);
+                    auto moved = clusters[from]->donate();
+                    clusters[to]->adopt(moved.first, moved.second, barrier);
+                    (*src)--;
+                    (*dst)++;
+                    migrations++;
+                }
+            }
+        public:
+            // clusters must be at most settings.CPU_COUNT, threads defaults to one per core (never more than there are clusters)
+            ParallelSystem(SystemSettings sett, std::size_t cluster_count, std::size_t tt = std::thread::hardware_concurrency()) :
+                settings(sett), threads(std::max<std::size_t>(1, std::min(tt, cluster_count))), window(std::max<Step>(1, sett.SWITCHING_IN_MIGRATION_DELAY)), migrations(0) {
+                if(cluster_count == 0 || cluster_count > sett.CPU_COUNT)
+                    throw "Bad cluster count " + std::to_string(cluster_count) + " for " + std::to_string(sett.CPU_COUNT) + " CPUs";
+                for(std::size_t c = 0; c < cluster_count; c++)
+                    clusters.push_back(std::make_unique<System>(clusterSettings(sett, c, cluster_count), MemoryMode::arena));
+            }
+
+            // the settings of cluster c: its share of the CPUs, with their speeds and power models
+            static SystemSettings clusterSettings(const SystemSettings& sett, std::size_t c, std::size_t count) {
+                SystemSettings out = sett;
+                CPUID base = sett.CPU_COUNT / count, extra = sett.CPU_COUNT % count;
+                CPUID first = c * base + std::min<CPUID>(c, extra);
+                out.CPU_COUNT = base + (c < extra ? 1 : 0);
+                if(!sett.CPU_SPEEDS.empty()) {
+                    out.CPU_SPEEDS.clear();
+                    for(CPUID i = 0; i < out.CPU_COUNT; i++)
+                        out.CPU_SPEEDS.push_back(sett.getCPUSpeed(first + i));
+                }
+                if(!sett.CPU_POWER.empty()) {
+                    out.CPU_POWER.clear();
+                    for(CPUID i = 0; i < out.CPU_COUNT; i++)
+                        out.CPU_POWER.push_back(sett.getCPUPower(first + i));
+                }
+                // each cluster draws its own lottery, cluster 0 from the run's seed (so one cluster matches a System)
+                if(c > 0)
+                    out.LOTTERY_SEED = splitmix64(sett.LOTTERY_SEED ^ splitmix64(c));
+                return out;
+            }
+
+            StepSum getMigrations() const {
+                return migrations;
+            }
+
+            void simulate(const std::vector<ProcessPlan>& data_files) {
+                // periodic tasks are released up front, so job ids are unique across clusters
+                bool periodic = std::any_of(data_files.begin(), data_files.end(), [](const ProcessPlan& pl){ return pl.init.period > 0 && pl.releases > 1; });
+                std::vector<ProcessPlan> all = periodic ? releaseJobs(data_files) : data_files;
+                plans.assign(clusters.size(), {});
+                for(std::size_t i = 0; i < all.size(); i++)
+                    plans[i % clusters.size()].push_back(all[i]);
+                for(std::size_t c = 0; c < clusters.size(); c++) {
+                    SystemSettings sett = clusterSettings(settings, c, clusters.size());
+                    sett.PROCESS_COUNT = plans[c].size();
+                    clusters[c]->updateSettings(sett);
+                    clusters[c]->load(plans[c]);
+                }
+                next.assign(clusters.size(), 0);
+                migrations = 0;
+
+                // thread t steps clusters t, t + threads, ...
+                Step end = window;
+                bool done = false;
+                std::exception_ptr error;
+                std::mutex error_mutex;
+                WindowBarrier barrier(threads);
+                auto work = [&](std::size_t t) {
+                    while(!done) {
+                        try {
+                            for(std::size_t c = t; c < clusters.size(); c += threads)
+                                advance(c, end);
+                        } catch(...) {
+                            std::lock_guard<std::mutex> lock(error_mutex);
+                            if(!error)
+                                error = std::current_exception();
+                        }
+                        barrier.arrive([&]() {
+                            if(error) {
+                                done = true;
+                                return;
+                            }
+                            done = std::all_of(clusters.begin(), clusters.end(), [](const std::unique_ptr<System>& s) { return s->finished(); });
+                            if(done) {
+                                // every cluster ends on the step the last one finished, as the CPUs of one System would
+                                end = *std::max_element(next.begin(), next.end());
+                                return;
+                            }
+                            balance(end);
+                            end = end <= std::numeric_limits<Step>::max() - window ? end + window : std::numeric_limits<Step>::max();
+                        });
+                    }
+                    if(!error)
+                        for(std::size_t c = t; c < clusters.size(); c += threads)
+                            pad(c, end);
+                };
+                std::vector<std::thread> pool;
+                for(std::size_t t = 1; t < threads; t++)
+                    pool.emplace_back(work, t);
+                work(0);
+                for(auto& th : pool)
+                    th.join();
+                if(error)
+                    std::rethrow_exception(error);
+            }
+
+            // the clusters' stats joined: processes cluster by cluster, CPUs renumbered in cluster order
+            SimulationStats outputStats() {
+                std::vector<ProcessStats> ps;
+                std::vector<CPUStats> cs;
+                std::vector<GroupStats> gs;
+                MemoryFootprint memory;
+                for(auto& sys : clusters) {
+                    SimulationStats part = sys->outputStats();
+                    for(auto& p : part.ps)
+                        ps.push_back(p);
+                    for(auto& c : part.cs) {
+                        cs.push_back(c);
+                        cs.back().id = cs.size() - 1;
+                    }
+                    gs.resize(part.gs.size());
+                    for(std::size_t g = 0; g < part.gs.size(); g++) {
+                        gs[g].id = g;
+                        gs[g].ran += part.gs[g].ran;
+                        gs[g].throttles += part.gs[g].throttles;
+                        gs[g].throttled += part.gs[g].throttled;
+                    }
+                    // peaks are summed, which bounds the peak of the whole run from above
+                    memory.accounted = part.memory.accounted;
+                    for(std::size_t i = 0; i <= MEMORY_PART_COUNT; i++) {
+                        AllocationCount& to = i < MEMORY_PART_COUNT ? memory.parts[i] : memory.total;
+                        const AllocationCount& from = i < MEMORY_PART_COUNT ? part.memory.parts[i] : part.memory.total;
+                        to.allocations += from.allocations;
+                        to.bytes += from.bytes;
+                        to.peak += from.peak;
+                    }
+                }
+                SimulationStats out(settings, ps.begin(), ps.end(), cs.begin(), cs.end());
+                out.memory = memory;
+                out.gs = gs;
+                if(memory.accounted)
+                    out.memory.stats_bytes = out.approxBytes();
+                return out;
+            }
+    };
+}
+
+#endif
@@ -0,0 +1,383 @@
+// defines the macro benchmark of the engine itself: wall time, simulated ticks per second, peak memory and export time over a grid of run sizes
+
+#ifndef PERF_H
+#define PERF_H
+
+#include "typedefs.h"
+#include "system.h"
+#include "stats.h"
+#include "workload.h"
+#include "results_store.h"
+#include <vector>
+#include <map>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <optional>
+#include <stdint.h>
+#include <unistd.h>
+
+namespace Simulation {
+    // every case runs the workload of this seed, so the simulated ticks of a case only change when the engine's results do
+    const uint64_t PERF_SEED = 1;
+    // wall times below this are too noisy to flag
+    const double PERF_MIN_SECONDS = 0.05;
+
+    // one run size of the benchmark
+    struct PerfCase {
+        uint64_t processes;
+        CPUID cpus;
+        Step rr;
+
+        std::string name() const {
+            return "p" + std::to_string(processes) + "_c" + std::to_string(cpus) + "_rr" + std::to_string(rr);
+        }
+        // the largest workloads need the PIDs of ScaleTraits (build with -DSIMULATION_SCALE)
+        bool fits() const {
+            return processes <= std::numeric_limits<PID>::max();
+        }
+    };
+
+    // quick: 10 to 10^4 processes on 1, 16 and 256 CPUs, under FCFS and RR 100
+    // full: 10 to 10^6 processes on 1 to 1024 CPUs, under FCFS, RR 10 and RR 100
+    // ordered by quantum, then CPUs, then processes, so each series of process counts grows (see runPerf's budget)
+    std::vector<PerfCase> perfGrid(bool full = false) {
+        std::vector<uint64_t> procs = {10, 100, 1000, 10000};
+        std::vector<CPUID> cpus = {1, 16, 256};
+        std::vector<Step> rrs = {0, 100};
+        if(full) {
+            procs = {10, 100, 1000, 10000, 100000, 1000000};
+            cpus = {1, 4, 16, 64, 256, 1024};
+            rrs = {0, 10, 100};
+        }
+        std::vector<PerfCase> out;
+        for(auto rr : rrs)
+            for(auto c : cpus)
+                for(auto p : procs)
+                    out.push_back({p, c, rr});
+        return out;
+    }
+
+    // the measurements of one case
+    struct PerfResult {
+        PerfCase run;
+        bool scale = sizeof(PID) > sizeof(CompactTraits::PID);     // built with ScaleTraits
+        std::string skipped;        // why the case was not run ("" if it was)
+        double wall = 0;            // seconds to simulate and collect the stats (best of the repeats)
+        StepSum ticks = 0;          // simulated steps
+        uint64_t peak_bytes = 0;    // most bytes the System held at once
+        double export_seconds = 0;  // seconds to write the run to a results file
+        bool timed = true;          // false if read from a file without the times (see writePerfResults)
+
+        double getTicksPerSecond() const {
+            return wall > 0 ? ticks / wall : 0;
+        }
+        // cases of the two traits are timed separately
+        std::string key() const {
+            return run.name() + (scale ? "_scale" : "");
+        }
+
+        // without times, only the columns which are the same on every machine
+        static std::string to_csv_header(bool times = true) {
+            if(!times)
+                return "Case,Scale,Processes,CPUs,RR Time,Skipped,Ticks,Peak Bytes";
+            return "Case,Scale,Processes,CPUs,RR Time,Skipped,Wall Seconds,Ticks,Ticks per Second,Peak Bytes,Export Seconds";
+        }
+        std::string to_csv_row(bool times = true) const {
+            std::ostringstream out;
+            out << std::setprecision(6) << run.name() << "," << scale << "," << run.processes << "," << run.cpus << "," << run.rr << "," << skipped << ",";
+            if(times)
+                out << wall << "," << ticks << "," << getTicksPerSecond() << "," << peak_bytes << "," << export_seconds;
+            else
+                out << ticks << "," << peak_bytes;
+            return out.str();
+        }
+        static PerfResult from_csv_row(const std::string& row, bool times = true) {
+            std::vector<std::string> f;
+            std::istringstream in(row);
+            std::string item;
+            while(std::getline(in, item, ','))
+                f.push_back(item);
+            if(row.back() == ',')
+                f.push_back("");
+            if(f.size() != (times ? 11 : 8))
+                throw "Bad benchmark row: " + row;
+            PerfResult out;
+            out.run = {std::stoull(f[2]), CPUID(std::stoull(f[3])), Step(std::stoull(f[4]))};
+            out.scale = f[1] == "1";
+            out.skipped = f[5];
+            out.timed = times;
+            if(times) {
+                out.wall = std::stod(f[6]);
+                out.ticks = std::stoull(f[7]);
+                out.peak_bytes = std::stoull(f[9]);
+                out.export_seconds = std::stod(f[10]);
+            } else {
+                out.ticks = std::stoull(f[6]);
+                out.peak_bytes = std::stoull(f[7]);
+            }
+            return out;
+        }
+    };
+
+    // reads a file of either form (see writePerfResults)
+    std::vector<PerfResult> readPerfResults(std::string path) {
+        std::ifstream f(path);
+        if(!f.is_open())
+            throw "Error opening file " + path;
+        std::vector<PerfResult> out;
+        std::string line;
+        std::getline(f, line);
+        bool times = line == PerfResult::to_csv_header();
+        if(!times && line != PerfResult::to_csv_header(false))
+            throw "Not a benchmark results file: " + path;
+        while(std::getline(f, line))
+            if(!line.empty())
+                out.push_back(PerfResult::from_csv_row(line, times));
+        return out;
+    }
+    // without times, the file holds only what every machine measures alike (ticks and peak bytes), so it can be shared
+    //      wall and export times only compare on the machine which measured them
+    void writePerfResults(std::string path, const std::vector<PerfResult>& results, bool times = true) {
+        std::ofstream f(path, std::ofstream::out);
+        if(!f.is_open())
+            throw "Error opening file " + path;
+        f << PerfResult::to_csv_header(times) << std::endl;
+        for(auto& r : results)
+            f << r.to_csv_row(times) << std::endl;
+    }
+
+    // the baseline to compare against: the cases of shared (ticks and peak bytes), timed by the same case of local if there is one
+    //      a case only in local is taken whole
+    std::vector<PerfResult> mergeBaselines(const std::vector<PerfResult>& shared, const std::vector<PerfResult>& local) {
+        std::map<std::string, PerfResult> timed;
+        for(auto& l : local)
+            if(l.timed)
+                timed[l.key()] = l;
+        std::vector<PerfResult> out;
+        for(auto& s : shared) {
+            out.push_back(s);
+            auto it = timed.find(s.key());
+            if(it == timed.end())
+                continue;
+            if((*it).second.skipped == "" && s.skipped == "") {
+                out.back().wall = (*it).second.wall;
+                out.back().export_seconds = (*it).second.export_seconds;
+                out.back().timed = true;
+            }
+            timed.erase(it);
+        }
+        for(auto& l : local)
+            if(timed.count(l.key()))
+                out.push_back(l);
+        return out;
+    }
+
+    // runs one case repeat times on a fresh System (its arena reused between repeats), keeping the fastest
+    //      the System counts its memory (MEMORY_ACCOUNTING), which costs a few additions per allocation
+    //      export is the columnar results file of the run (as a sweep writes), in folder, deleted afterwards
+    PerfResult runPerfCase(const PerfCase& c, unsigned repeat, std::string folder) {
+        PerfResult out;
+        out.run = c;
+        SystemSettings sett;
+        sett.PROCESS_COUNT = c.processes;
+        sett.CPU_COUNT = c.cpus;
+        sett.RR_TIME = c.rr;
+        sett.MEMORY_ACCOUNTING = true;
+        std::vector<ProcessPlan> plans = generateDataFiles(PID(c.processes), PERF_SEED);
+
+        System sys(sett, MemoryMode::arena);
+        std::optional<SimulationStats> stats;
+        for(unsigned r = 0; r < std::max(1u, repeat); r++) {
+            auto start = std::chrono::steady_clock::now();
+            sys.updateSettings(sett);
+            sys.simulate(plans);
+            stats.emplace(sys.outputStats());
+            double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            out.wall = r == 0 ? secs : std::min(out.wall, secs);
+        }
+        out.ticks = stats->cs.front().hist.duration();
+        out.peak_bytes = stats->getPeakBytes();
+
+        std::string path = folder + "/" + out.key() + ".simr";
+        unlink(path.c_str());
+        auto start = std::chrono::steady_clock::now();
+        std::vector<ResultsTable> tables = toResultsTables(*stats, 0);
+        tables.front().add("summary", std::vector<std::string>{stats->to_csv_row()});
+        appendResults(path, tables);
+        out.export_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        unlink(path.c_str());
+        return out;
+    }
+
+    // runs every case of grid, printing a line per case
+    //      a case is skipped if its process count does not fit the PID type,
+    //      or (with max_seconds > 0) if the previous case of its series, scaled linearly by process count, took longer than max_seconds
+    std::vector<PerfResult> runPerf(const std::vector<PerfCase>& grid, unsigned repeat, std::string folder, double max_seconds = 0) {
+        std::string cmd = "mkdir -p " + folder;
+        system(cmd.c_str());
+        std::vector<PerfResult> out;
+        std::map<std::pair<Step, CPUID>, PerfResult> last;     // of each series
+        for(auto& c : grid) {
+            PerfResult r;
+            r.run = c;
+            auto prev = last.find({c.rr, c.cpus});
+            if(!c.fits()) {
+                r.skipped = "needs SIMULATION_SCALE";
+            } else if(max_seconds > 0 && prev != last.end() && (*prev).second.wall * c.processes / (*prev).second.run.processes > max_seconds) {
+                r.skipped = "over budget";
+            } else {
+                r = runPerfCase(c, repeat, folder);
+                last[{c.rr, c.cpus}] = r;
+            }
+            std::cout << std::left << std::setw(24) << r.key() << std::right;
+            if(r.skipped != "")
+                std::cout << "skipped (" << r.skipped << ")" << std::endl;
+            else
+                std::cout << std::setprecision(4) << r.wall << " s, " << r.getTicksPerSecond() << " ticks/s, " << r.peak_bytes << " bytes, export " << r.export_seconds << " s" << std::endl;
+            out.push_back(r);
+        }
+        return out;
+    }
+
+    // the results of a run against a baseline, case by case
+    //      slower / faster: wall time beyond tolerance either way (ignored below PERF_MIN_SECONDS, and if the baseline has no times)
+    //      memory: peak bytes above memory_tolerance (memory is deterministic, so it only needs a small margin)
+    //      export: export time slower beyond tolerance
+    //      ticks: the simulated steps differ, so the engine's results changed and the times are not like for like
+    //      the exponent is the slope of log wall time over log process count from the previous case of the series (1: linear)
+    struct PerfReport {
+        struct Row {
+            PerfResult now;
+            std::optional<PerfResult> base;
+            double ratio = 0;           // wall time over the baseline's (0 if the baseline has no times)
+            double exponent = std::numeric_limits<double>::quiet_NaN();
+            std::vector<std::string> flags;
+
+            bool regressed() const {
+                for(auto& f : flags)
+                    if(f == "slower" || f == "memory" || f == "export")
+                        return true;
+                return false;
+            }
+        };
+
+        std::vector<Row> rows;
+        double tolerance;
+        double memory_tolerance;
+
+        bool regressed() const {
+            return std::any_of(rows.begin(), rows.end(), [](const Row& r) { return r.regressed(); });
+        }
+
+        static std::string to_csv_header() {
+            return "Case,Processes,CPUs,RR Time,Wall Seconds,Ticks per Second,Peak Bytes,Export Seconds,Baseline Wall Seconds,Baseline Peak Bytes,Wall Ratio,Scaling Exponent,Flags";
+        }
+        std::string to_csv() const {
+            std::ostringstream out;
+            out << std::setprecision(5);
+            for(auto& r : rows) {
+                out << r.now.key() << "," << r.now.run.processes << "," << r.now.run.cpus << "," << r.now.run.rr << ",";
+                if(r.now.skipped == "")
+                    out << r.now.wall << "," << r.now.getTicksPerSecond() << "," << r.now.peak_bytes << "," << r.now.export_seconds << ",";
+                else
+                    out << ",,,,";
+                if(r.base && r.base->skipped == "" && r.base->timed)
+                    out << r.base->wall << "," << r.base->peak_bytes << "," << r.ratio << ",";
+                else if(r.base && r.base->skipped == "")
+                    out << "," << r.base->peak_bytes << ",,";
+                else
+                    out << ",,,";
+                if(!std::isnan(r.exponent))
+                    out << r.exponent;
+                out << ",";
+                for(std::size_t i = 0; i < r.flags.size(); i++)
+                    out << (i ? " " : "") << r.flags[i];
+                out << std::endl;
+            }
+            return out.str();
+        }
+
+        void print() const {
+            std::cout << std::endl << "Benchmark Report (tolerance " << 100 * tolerance << "% time, " << 100 * memory_tolerance << "% memory):" << std::endl;
+            std::cout << "    " << std::left << std::setw(24) << "Case" << std::right << std::setw(11) << "Wall s" << std::setw(14) << "Ticks/s" << std::setw(14) << "Peak MB"
+                << std::setw(11) << "Export s" << std::setw(9) << "vs Base" << std::setw(9) << "Scaling" << "  Flags" << std::endl;
+            for(auto& r : rows) {
+                std::cout << "    " << std::left << std::setw(24) << r.now.key() << std::right << std::setprecision(4);
+                if(r.now.skipped == "") {
+                    std::cout << std::setw(11) << r.now.wall << std::setw(14) << r.now.getTicksPerSecond() << std::setw(14) << r.now.peak_bytes / 1048576.0 << std::setw(11) << r.now.export_seconds;
+                    if(r.base && r.base->skipped == "" && r.base->timed)
+                        std::cout << std::setw(8) << r.ratio << "x";
+                    else
+                        std::cout << std::setw(9) << "-";
+                    if(!std::isnan(r.exponent))
+                        std::cout << std::setw(9) << r.exponent;
+                    else
+                        std::cout << std::setw(9) << "-";
+                } else {
+                    std::cout << std::setw(11 + 14 + 14 + 11 + 9 + 9) << "";
+                }
+                std::cout << " ";
+                for(auto& f : r.flags)
+                    std::cout << " " << f;
+                std::cout << std::endl;
+            }
+            std::size_t regressions = std::count_if(rows.begin(), rows.end(), [](const Row& r) { return r.regressed(); });
+            std::cout << "    " << regressions << " of " << rows.size() << " cases regressed" << std::endl << std::endl;
+        }
+    };
+
+    PerfReport comparePerf(const std::vector<PerfResult>& now, const std::vector<PerfResult>& baseline, double tolerance = 0.25, double memory_tolerance = 0.05) {
+        PerfReport out;
+        out.tolerance = tolerance;
+        out.memory_tolerance = memory_tolerance;
+        std::map<std::string, PerfResult> base;
+        for(auto& b : baseline)
+            base[b.key()] = b;
+        std::map<std::pair<Step, CPUID>, PerfResult> last;     // of each series
+        for(auto& r : now) {
+            PerfReport::Row row;
+            row.now = r;
+            auto it = base.find(r.key());
+            if(it != base.end())
+                row.base = (*it).second;
+            if(r.skipped != "") {
+                row.flags.push_back("skipped");
+                out.rows.push_back(row);
+                continue;
+            }
+            auto prev = last.find({r.run.rr, r.run.cpus});
+            if(prev != last.end() && (*prev).second.wall > 0 && r.wall > 0)
+                row.exponent = std::log(r.wall / (*prev).second.wall) / std::log(r.run.processes / (double)((*prev).second.run.processes));
+            last[{r.run.rr, r.run.cpus}] = r;
+
+            if(!row.base || row.base->skipped != "") {
+                row.flags.push_back("new");
+            } else {
+                const PerfResult& b = *row.base;
+                if(b.timed) {
+                    row.ratio = b.wall > 0 ? r.wall / b.wall : 0;
+                    if(r.wall > b.wall * (1 + tolerance) && r.wall >= PERF_MIN_SECONDS)
+                        row.flags.push_back("slower");
+                    else if(r.wall * (1 + tolerance) < b.wall && b.wall >= PERF_MIN_SECONDS)
+                        row.flags.push_back("faster");
+                }
+                if(r.peak_bytes > b.peak_bytes * (1 + memory_tolerance))
+                    row.flags.push_back("memory");
+                if(b.timed && r.export_seconds > b.export_seconds * (1 + tolerance) && r.export_seconds >= PERF_MIN_SECONDS)
+                    row.flags.push_back("export");
+                if(r.ticks != b.ticks)
+                    row.flags.push_back("ticks");
+            }
+            out.rows.push_back(row);
+        }
+        return out;
+    }
+}
+
+#endif
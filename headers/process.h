@@ -10,31 +10,66 @@
 #include <iostream>
 #include <iomanip>
 #include <string>
+#include <limits>
 
 namespace Simulation {
     struct PCB {
+        // last_cpu of a process moved in from another System, which is none of this System's CPUs
+        static constexpr CPUID MIGRATED = std::numeric_limits<CPUID>::max() - 1;
+
         const PID id;
         ProcessState state;         // handled by CPU (and System, in case of unblocking)
         const Priority prio;
         ProcessStats stats;
         ProcessBursts bursts;       // handled by CPU
+        CPUID last_cpu;             // CPU this process last ran on (max value if it has not run yet), handled by CPU
+        StepSum ran;                // steps spent running, counted here so the stride scheduler need not walk the History
+
+        // allocator-aware so the System's containers can place a PCB (and its bursts and history) in their memory resource
+        using allocator_type = std::pmr::polymorphic_allocator<std::byte>;
 
-        PCB(const ProcessInit& pi, Step curr) : 
+        PCB(const ProcessInit& pi, Step curr, const allocator_type& alloc = {}) : 
             id(pi.id), 
             state(ProcessState::ready),
             prio(pi.prio),
-            bursts(pi.bursts),
-            stats(pi, curr, History<ProcessState>()) {}
+            stats(pi, curr, alloc),
+            bursts(pi.bursts, alloc),
+            last_cpu(std::numeric_limits<CPUID>::max()),
+            ran(0) {}
+        PCB(const PCB& other) = default;
+        PCB(const PCB& other, const allocator_type& alloc) :
+            id(other.id),
+            state(other.state),
+            prio(other.prio),
+            stats(other.stats, alloc),
+            bursts(other.bursts, alloc),
+            last_cpu(other.last_cpu),
+            ran(other.ran) {}
         
-        bool step() {
+        // work is the number of steps of the current burst completed in this Step (CPU speed)
+        bool step(Step work = 1) {
             // this function may be called in the blocked/exit state (when the context is switching out)
             // but that time is not counted as "waited" because the process is not ready yet
             // for these purposes, "waiting" implies wasting clocks cycles while ready
             stats.hist.inc(state);
-            if(state == ProcessState::running || state == ProcessState::blocked)
-                return bursts.step();
+            if(state == ProcessState::running)
+                ran++;
+            if((state == ProcessState::running || state == ProcessState::blocked) && bursts.step(work)) {
+                noteNextBurst();
+                return true;
+            }
             return false;
         }
+        // ends the current burst outright (IO served by a device)
+        void popBurst() {
+            bursts.pop();
+            noteNextBurst();
+        }
+        // a lazy process's next burst was just drawn, so the stats' plan grows by it
+        void noteNextBurst() {
+            if(bursts.isLazy() && !bursts.empty())
+                stats.plan.add(bursts.front(), bursts.isProcessing());
+        }
     };
 
     void printPCB(const PCB& pcb, int indent = 0) {
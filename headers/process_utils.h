@@ -5,30 +5,128 @@
 
 #include "typedefs.h"
 #include <list>
+#include <memory_resource>
 #include <iostream>
 #include <string>
+#include <algorithm>
+#include <optional>
+#include <limits>
+#include <stdint.h>
 
 namespace Simulation {
+    // SplitMix64 finaliser, used to derive independent substream seeds from a seed
+    uint64_t splitmix64(uint64_t x) {
+        x += 0x9e3779b97f4a7c15ull;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    }
+
+    // draws the bursts of a process one at a time, from a SplitMix64 stream
+    //      its state is the same few words however many bursts are left, so a process can be arbitrarily long, or endless
+    class BurstGenerator {
+        private:
+            uint64_t state;
+            uint64_t left;      // bursts still to draw
+            Step max_cpu;
+            Step max_io;
+        public:
+            static constexpr uint64_t UNLIMITED = std::numeric_limits<uint64_t>::max();
+
+            // count bursts (UNLIMITED never runs out), CPU bursts in [1, mc] and IO bursts in [1, mi]
+            BurstGenerator(uint64_t seed, uint64_t count, Step mc = MAX_CPU_BURST, Step mi = MAX_IO_BURST) : state(seed), left(count), max_cpu(mc), max_io(mi) {}
+
+            bool done() const {
+                return left == 0;
+            }
+            uint64_t remaining() const {
+                return left;
+            }
+            // the next burst, a CPU burst if processing (only meaningful if not done)
+            Step next(bool processing) {
+                if(left != UNLIMITED)
+                    left--;
+                state += 0x9e3779b97f4a7c15ull;
+                return splitmix64(state) % (processing ? max_cpu : max_io) + 1;
+            }
+            // everything the remaining bursts depend on, e.g. for a cache key
+            template<class F>
+            void fingerprint(F add) const {
+                add(state);
+                add(left);
+                add(uint64_t(max_cpu));
+                add(uint64_t(max_io));
+            }
+    };
+
+    // totals of a process's bursts, which is all the stats keep of its plan
+    struct BurstSummary {
+        bool first_processing = true;
+        StepSum count = 0;
+        StepSum length = 0;         // total steps
+        StepSum cpu_length = 0;     // steps of CPU bursts
+        Step max_cpu_burst = 0;
+
+        void add(Step burst, bool processing) {
+            if(count++ == 0)
+                first_processing = processing;
+            length += burst;
+            if(processing) {
+                cpu_length += burst;
+                max_cpu_burst = std::max(max_cpu_burst, burst);
+            }
+        }
+    };
+
+    // the CPU and IO bursts a process has left, alternating, the front one being in progress
+    // either a list of every burst, or (with a BurstGenerator) only the front one, the next being drawn when it finishes
     class ProcessBursts {
         private:
-            std::list<Step> bursts;
+            std::pmr::list<Step> bursts;
             bool processing;
+            std::optional<BurstGenerator> gen;
         public:
+            using allocator_type = std::pmr::polymorphic_allocator<std::byte>;
+
             template<class iterator_type>
-            ProcessBursts(iterator_type first, iterator_type last, bool proc = true) : bursts(first, last), processing(proc) {}
+            ProcessBursts(iterator_type first, iterator_type last, bool proc = true, const allocator_type& alloc = {}) : bursts(first, last, alloc), processing(proc) {}
+            ProcessBursts(BurstGenerator g, bool proc = true, const allocator_type& alloc = {}) : bursts(alloc), processing(proc), gen(g) {
+                if(!gen->done())
+                    bursts.push_back(gen->next(processing));
+            }
+            ProcessBursts(const ProcessBursts& other) = default;
+            ProcessBursts(const ProcessBursts& other, const allocator_type& alloc) : bursts(other.bursts, alloc), processing(other.processing), gen(other.gen) {}
+            ProcessBursts& operator=(const ProcessBursts& other) = default;
             bool isProcessing() const {
                 return processing;
             }
-            typename std::list<Step>::const_iterator cbegin() const {
+            // the bursts after the front one are drawn as it finishes
+            bool isLazy() const {
+                return gen.has_value();
+            }
+            const std::optional<BurstGenerator>& generator() const {
+                return gen;
+            }
+            // of the bursts held so far (every burst, unless lazy)
+            BurstSummary summarize() const {
+                BurstSummary out;
+                bool p = processing;
+                for(auto b : bursts) {
+                    out.add(b, p);
+                    p = !p;
+                }
+                return out;
+            }
+            typename std::pmr::list<Step>::const_iterator cbegin() const {
                 return bursts.cbegin();
             }
-            typename std::list<Step>::const_iterator cend() const {
+            typename std::pmr::list<Step>::const_iterator cend() const {
                 return bursts.cend();
             }
-            std::list<Step>::size_type size() const {
+            std::pmr::list<Step>::size_type size() const {
                 return bursts.size();
             }
-            // gets the total number of CPU PROCESSING steps remaining
+            // gets the total number of CPU PROCESSING steps remaining (of the bursts held so far, if lazy)
             Step stepsRemaining() const {
                 Step total = 0;
                 // start at next processing block
@@ -53,12 +151,18 @@ namespace Simulation {
             void pop() {
                 bursts.pop_front();
                 processing = !processing;
+                if(gen && !gen->done())
+                    bursts.push_back(gen->next(processing));
             }
-            bool step() {
-                // NOTE:              VV embedded drecement
-                if(!bursts.empty() && --bursts.front() == 0) {
-                    pop();
-                    return true;
+            // completes work steps of the current burst
+            // returns true if that finished the burst
+            bool step(Step work = 1) {
+                if(!bursts.empty() && work > 0) {
+                    if(bursts.front() <= work) {
+                        pop();
+                        return true;
+                    }
+                    bursts.front() -= work;
                 }
                 return false;
             }
@@ -82,11 +186,23 @@ namespace Simulation {
         PID id;
         Priority prio;
         ProcessBursts bursts;
+        unsigned tickets = 0;       // weight under the proportional-share schedulers (0: derived from prio)
+        Step deadline = 0;          // steps after arrival by which the process should have finished (0: none)
+        Step period = 0;            // release interval of a periodic task (0: not periodic), see ProcessPlan::releases
+        std::size_t group = 0;      // index into SystemSettings::GROUPS under Scheduler::fair
     };
 
+    // explicit tickets, else one more ticket per level of priority (MAX_PRIO gets 1)
+    unsigned ticketsFor(const ProcessInit& pi) {
+        return pi.tickets > 0 ? pi.tickets : MAX_PRIO + 1 - std::min<unsigned>(pi.prio, MAX_PRIO);
+    }
+
     struct ProcessPlan {
         Step arrival;
         ProcessInit init;
+        // with init.period, the plan is a periodic task releasing this many jobs, one every period steps from arrival
+        //  each job is a separate process with the task's bursts and relative deadline (see releaseJobs)
+        unsigned releases = 1;
     };
 }
 
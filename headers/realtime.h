@@ -0,0 +1,73 @@
+// defines DeadlineQueue, the ready queue of the earliest-deadline-first scheduler
+
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include "typedefs.h"
+#include "utility.h"
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <stdint.h>
+
+namespace Simulation {
+    // a binary min-heap on (absolute deadline, push order), so push and take are O(log n) and nothing is kept per PID
+    //      the heap is a plain vector (ordered by std::greater), so it can be walked
+    //      processes without a deadline are pushed with NO_DEADLINE and so are served FIFO once no deadline is waiting
+    class DeadlineQueue {
+        public:
+            using Entry = ReadyPriorityQueue<PID>::Entry;
+            static constexpr StepSum NO_DEADLINE = std::numeric_limits<StepSum>::max();
+        private:
+            struct Item {
+                StepSum due;
+                uint64_t seq;
+                PID id;
+                Step since;
+
+                friend bool operator>(const Item& a, const Item& b) {
+                    return a.due != b.due ? a.due > b.due : a.seq > b.seq;
+                }
+            };
+            std::vector<Item> heap;
+            uint64_t seq;
+        public:
+            DeadlineQueue() : seq(0) {}
+
+            bool empty() const {
+                return heap.empty();
+            }
+            std::size_t size() const {
+                return heap.size();
+            }
+            void clear() {
+                heap.clear();
+                seq = 0;
+            }
+
+            void push(PID id, StepSum due, Step since) {
+                heap.push_back({due, seq++, id, since});
+                std::push_heap(heap.begin(), heap.end(), std::greater<Item>());
+            }
+            // calls f(PID) for every ready process, in no particular order
+            template<class F>
+            void forEach(F f) const {
+                for(auto& it : heap)
+                    f(it.id);
+            }
+            // absolute deadline of the next process (only meaningful if not empty)
+            StepSum nextDue() const {
+                return heap.front().due;
+            }
+            // removes the process with the earliest deadline (only meaningful if not empty)
+            Entry take() {
+                std::pop_heap(heap.begin(), heap.end(), std::greater<Item>());
+                Item top = heap.back();
+                heap.pop_back();
+                return {top.id, top.since};
+            }
+    };
+}
+
+#endif
@@ -0,0 +1,460 @@
+// defines an append-only columnar results file, so a sweep can be loaded without parsing a folder tree per run
+
+#ifndef RESULTS_STORE_H
+#define RESULTS_STORE_H
+
+#include "typedefs.h"
+#include "stats.h"
+#include <vector>
+#include <map>
+#include <string>
+#include <cstring>
+#include <random>
+#include <atomic>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace Simulation {
+    // file layout: a sequence of self-contained chunks, each appended by a single write
+    //      chunk:  "SIMR", uint32 version, uint64 bytes (of the rest of the chunk), uint32 table count, uint32 pad, tables
+    //      table:  uint32 name length, uint32 pad, name, uint64 rows, uint32 column count, uint32 pad, columns
+    //      column: uint32 name length, uint8 type, 3 pad, name, data
+    //          u64/f64 data is rows 8-byte values, str data is rows+1 uint64 offsets followed by the characters
+    //      every name and data block is padded to 8 bytes, so a mapped file can be read in place
+    // the same table may appear in many chunks (one per run), a reader concatenates them
+    //      columns missing from a chunk (e.g. written by an older version) read as 0 or ""
+    enum class ColumnType : uint8_t {u64, f64, str};
+
+    struct ResultsColumn {
+        std::string name;
+        ColumnType type;
+        std::vector<uint64_t> u;
+        std::vector<double> f;
+        std::vector<std::string> s;
+    };
+
+    // the rows one writer appends to a table
+    class ResultsTable {
+        private:
+            std::string name;
+            uint64_t rows;
+            std::vector<ResultsColumn> columns;
+
+            static void pad(std::string& buf) {
+                buf.append((8 - buf.size() % 8) % 8, '\0');
+            }
+            template<class T>
+            static void put(std::string& buf, T v) {
+                buf.append(reinterpret_cast<const char*>(&v), sizeof(T));
+            }
+            void check(std::size_t n) {
+                if(columns.size() > 1 && n != rows)
+                    throw "Column length mismatch in table " + name;
+                rows = n;
+            }
+        public:
+            ResultsTable(std::string nn) : name(nn), rows(0) {}
+
+            void add(std::string col, std::vector<uint64_t> vals) {
+                columns.push_back({col, ColumnType::u64, vals, {}, {}});
+                check(vals.size());
+            }
+            void add(std::string col, std::vector<double> vals) {
+                columns.push_back({col, ColumnType::f64, {}, vals, {}});
+                check(vals.size());
+            }
+            void add(std::string col, std::vector<std::string> vals) {
+                columns.push_back({col, ColumnType::str, {}, {}, vals});
+                check(vals.size());
+            }
+
+            void encode(std::string& buf) const {
+                put<uint32_t>(buf, name.size());
+                put<uint32_t>(buf, 0);
+                buf += name;
+                pad(buf);
+                put<uint64_t>(buf, rows);
+                put<uint32_t>(buf, columns.size());
+                put<uint32_t>(buf, 0);
+                for(auto& c : columns) {
+                    put<uint32_t>(buf, c.name.size());
+                    put<uint8_t>(buf, (uint8_t)(c.type));
+                    buf.append(3, '\0');
+                    buf += c.name;
+                    pad(buf);
+                    switch(c.type) {
+                        case ColumnType::u64:
+                            for(auto v : c.u)
+                                put(buf, v);
+                            break;
+                        case ColumnType::f64:
+                            for(auto v : c.f)
+                                put(buf, v);
+                            break;
+                        case ColumnType::str: {
+                            uint64_t off = 0;
+                            put(buf, off);
+                            for(auto& v : c.s)
+                                put(buf, off += v.size());
+                            for(auto& v : c.s)
+                                buf += v;
+                            pad(buf);
+                            break;
+                        }
+                    }
+                }
+            }
+    };
+
+    // appends an encoded chunk (or several, back to back)
+    // the file is locked for the write, so parallel workers (threads or processes) can share one file
+    void appendChunk(std::string path, const std::string& buf) {
+        int fd = open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+        if(fd < 0)
+            throw "Error opening file " + path;
+        flock(fd, LOCK_EX);
+        std::size_t done = 0;
+        while(done < buf.size()) {
+            ssize_t n = write(fd, buf.data() + done, buf.size() - done);
+            if(n <= 0) {
+                flock(fd, LOCK_UN);
+                close(fd);
+                throw "Error writing file " + path;
+            }
+            done += n;
+        }
+        flock(fd, LOCK_UN);
+        close(fd);
+    }
+
+    // appends one chunk holding tables
+    void appendResults(std::string path, const std::vector<ResultsTable>& tables) {
+        std::string buf("SIMR");
+        uint32_t version = 1;
+        buf.append(reinterpret_cast<const char*>(&version), sizeof(version));
+        buf.append(8, '\0');    // size, filled in below
+        uint32_t count[2] = {(uint32_t)(tables.size()), 0};
+        buf.append(reinterpret_cast<const char*>(count), sizeof(count));
+        for(auto& t : tables)
+            t.encode(buf);
+        uint64_t bytes = buf.size() - 16;
+        std::memcpy(&buf[8], &bytes, sizeof(bytes));
+        appendChunk(path, buf);
+    }
+
+    // read-only view of a results file, mapped into memory
+    // a chunk cut short (e.g. by a crash mid-write) ends the file
+    class ResultsStore {
+        private:
+            struct ColumnRef {
+                ColumnType type;
+                const char* data;
+            };
+            struct TablePart {
+                uint64_t rows;
+                std::map<std::string, ColumnRef> columns;
+            };
+
+            const char* base;
+            std::size_t bytes;
+            std::map<std::string, std::vector<TablePart>> tables;
+            std::vector<std::pair<std::size_t, std::size_t>> chunks;     // (offset, bytes) of every complete chunk
+
+            static uint64_t padded(uint64_t n) {
+                return (n + 7) / 8 * 8;
+            }
+            template<class T>
+            static T get(const char* p) {
+                T v;
+                std::memcpy(&v, p, sizeof(T));
+                return v;
+            }
+
+            // indexes every complete chunk
+            void scan() {
+                std::size_t pos = 0;
+                while(pos + 24 <= bytes && std::memcmp(base + pos, "SIMR", 4) == 0) {
+                    uint64_t size = get<uint64_t>(base + pos + 8);
+                    if(pos + 16 + size > bytes)
+                        break;
+                    const char* p = base + pos + 16;
+                    uint32_t table_count = get<uint32_t>(p);
+                    p += 8;
+                    for(uint32_t t = 0; t < table_count; t++) {
+                        uint32_t name_len = get<uint32_t>(p);
+                        std::string name(p + 8, name_len);
+                        p += 8 + padded(name_len);
+                        TablePart part;
+                        part.rows = get<uint64_t>(p);
+                        uint32_t column_count = get<uint32_t>(p + 8);
+                        p += 16;
+                        for(uint32_t c = 0; c < column_count; c++) {
+                            uint32_t col_len = get<uint32_t>(p);
+                            ColumnType type = (ColumnType)(get<uint8_t>(p + 4));
+                            std::string col(p + 8, col_len);
+                            p += 8 + padded(col_len);
+                            part.columns[col] = {type, p};
+                            if(type == ColumnType::str)
+                                p += 8 * (part.rows + 1) + padded(get<uint64_t>(p + 8 * part.rows));
+                            else
+                                p += 8 * part.rows;
+                        }
+                        tables[name].push_back(part);
+                    }
+                    chunks.push_back({pos, 16 + size});
+                    pos += 16 + size;
+                }
+            }
+
+            const std::vector<TablePart>& parts(const std::string& table) const {
+                auto it = tables.find(table);
+                if(it == tables.end())
+                    throw "No table " + table;
+                return (*it).second;
+            }
+
+            // concatenates a column over every chunk, checking its type
+            template<class T, class Read>
+            std::vector<T> gather(const std::string& table, const std::string& col, ColumnType type, Read read) const {
+                std::vector<T> out;
+                out.reserve(rows(table));
+                for(auto& part : parts(table)) {
+                    auto it = part.columns.find(col);
+                    if(it == part.columns.end()) {
+                        out.resize(out.size() + part.rows);
+                        continue;
+                    }
+                    if((*it).second.type != type)
+                        throw "Wrong type for column " + table + "." + col;
+                    for(uint64_t r = 0; r < part.rows; r++)
+                        out.push_back(read((*it).second.data, part.rows, r));
+                }
+                return out;
+            }
+        public:
+            ResultsStore(std::string path) : base(nullptr), bytes(0) {
+                int fd = open(path.c_str(), O_RDONLY);
+                if(fd < 0)
+                    throw "Error opening file " + path;
+                struct stat st;
+                if(fstat(fd, &st) != 0) {
+                    close(fd);
+                    throw "Error reading file " + path;
+                }
+                bytes = st.st_size;
+                if(bytes > 0) {
+                    void* p = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+                    if(p == MAP_FAILED) {
+                        close(fd);
+                        throw "Error mapping file " + path;
+                    }
+                    base = static_cast<const char*>(p);
+                }
+                close(fd);
+                scan();
+            }
+            ResultsStore(const ResultsStore&) = delete;
+            ResultsStore& operator=(const ResultsStore&) = delete;
+            ~ResultsStore() {
+                if(base)
+                    munmap(const_cast<char*>(base), bytes);
+            }
+
+            // raw chunks, in file order (rows of every table are concatenated in this order)
+            std::size_t chunkCount() const {
+                return chunks.size();
+            }
+            std::string getChunk(std::size_t i) const {
+                return std::string(base + chunks[i].first, chunks[i].second);
+            }
+
+            std::vector<std::string> getTables() const {
+                std::vector<std::string> out;
+                for(auto& t : tables)
+                    out.push_back(t.first);
+                return out;
+            }
+            // every column name used by any chunk of table
+            std::vector<std::string> getColumns(const std::string& table) const {
+                std::map<std::string, ColumnType> cols;
+                for(auto& part : parts(table))
+                    for(auto& c : part.columns)
+                        cols[c.first] = c.second.type;
+                std::vector<std::string> out;
+                for(auto& c : cols)
+                    out.push_back(c.first);
+                return out;
+            }
+            uint64_t rows(const std::string& table) const {
+                uint64_t total = 0;
+                for(auto& part : parts(table))
+                    total += part.rows;
+                return total;
+            }
+
+            std::vector<uint64_t> u64(const std::string& table, const std::string& col) const {
+                return gather<uint64_t>(table, col, ColumnType::u64, [](const char* d, uint64_t, uint64_t r) {
+                    return get<uint64_t>(d + 8 * r);
+                });
+            }
+            std::vector<double> f64(const std::string& table, const std::string& col) const {
+                return gather<double>(table, col, ColumnType::f64, [](const char* d, uint64_t, uint64_t r) {
+                    return get<double>(d + 8 * r);
+                });
+            }
+            std::vector<std::string> str(const std::string& table, const std::string& col) const {
+                return gather<std::string>(table, col, ColumnType::str, [](const char* d, uint64_t rows, uint64_t r) {
+                    uint64_t from = get<uint64_t>(d + 8 * r);
+                    uint64_t to = get<uint64_t>(d + 8 * (r + 1));
+                    return std::string(d + 8 * (rows + 1) + from, to - from);
+                });
+            }
+    };
+
+    // a run as two tables
+    //      runs: one row of typed settings and summary metrics
+    //      processes: one row per process
+    //      both carry a run id to join them
+    std::vector<ResultsTable> toResultsTables(const SimulationStats& stats, uint64_t run) {
+        const SystemSettings& sett = stats.settings;
+        std::string name = to_string(sett);
+
+        ResultsTable runs("runs");
+        runs.add("run", std::vector<uint64_t>{run});
+        runs.add("settings", std::vector<std::string>{name});
+        runs.add("cpu_count", std::vector<uint64_t>{sett.CPU_COUNT});
+        runs.add("process_count", std::vector<uint64_t>{sett.PROCESS_COUNT});
+        runs.add("rr_time", std::vector<uint64_t>{sett.RR_TIME});
+        runs.add("switching_in_delay", std::vector<uint64_t>{sett.SWITCHING_IN_DELAY});
+        runs.add("switching_out_delay", std::vector<uint64_t>{sett.SWITCHING_OUT_DELAY});
+        runs.add("switching_in_warm_delay", std::vector<uint64_t>{sett.SWITCHING_IN_WARM_DELAY});
+        runs.add("switching_in_migration_delay", std::vector<uint64_t>{sett.SWITCHING_IN_MIGRATION_DELAY});
+        runs.add("affinity_dispatch", std::vector<uint64_t>{sett.AFFINITY_DISPATCH});
+        runs.add("preemptive", std::vector<uint64_t>{sett.PREEMPTIVE});
+        runs.add("aging_interval", std::vector<uint64_t>{sett.AGING_INTERVAL});
+        runs.add("scheduler", std::vector<std::string>{to_string(sett.SCHEDULER)});
+        runs.add("io_devices", std::vector<uint64_t>{sett.IO_DEVICES.size()});
+        runs.add("groups", std::vector<uint64_t>{sett.GROUPS.size()});
+
+        const History<CPUState>& cpu = stats.collapseCPUHistory();
+        runs.add("process_length", std::vector<double>{stats.getAvgProcessLength()});
+        runs.add("turnaround", std::vector<double>{stats.getAvgTurnaround()});
+        runs.add("wait", std::vector<double>{stats.getAvgWait()});
+        runs.add("response", std::vector<double>{stats.getAvgResponse()});
+        runs.add("response_adjusted", std::vector<double>{stats.getAvgResponseAdjusted()});
+        runs.add("throughput", std::vector<double>{stats.getThroughput()});
+        runs.add("cpu_processing", std::vector<double>{cpu.duration(CPUState::processing) / (double)(cpu.duration())});
+        runs.add("io_wait", std::vector<double>{stats.getAvgIOWait()});
+        runs.add("io_service", std::vector<double>{stats.getAvgIOService()});
+        runs.add("warm_switch_rate", std::vector<double>{stats.getWarmSwitchRate()});
+        runs.add("migration_rate", std::vector<double>{stats.getMigrationRate()});
+        runs.add("preemptions", std::vector<uint64_t>{stats.getPreemptions()});
+        runs.add("max_ready_wait", std::vector<uint64_t>{stats.getLatencyProfile().all.max_ready_wait});
+        runs.add("share_error", std::vector<double>{stats.getShareProfile().error()});
+        const DeadlineProfile& dl = stats.getDeadlineProfile();
+        runs.add("deadline_count", std::vector<uint64_t>{dl.count});
+        runs.add("deadline_misses", std::vector<uint64_t>{dl.misses});
+        runs.add("avg_lateness", std::vector<double>{dl.getAvgLateness()});
+        runs.add("tardiness_p99", std::vector<double>{dl.tardiness.percentile(99)});
+        runs.add("deadline_demand", std::vector<double>{dl.getDemand()});
+        runs.add("deadline_bound", std::vector<double>{dl.getBound(stats.cs.size())});
+        runs.add("governor", std::vector<std::string>{to_string(sett.GOVERNOR)});
+        runs.add("energy", std::vector<double>{stats.getEnergy()});
+        runs.add("energy_per_process", std::vector<double>{stats.getEnergyPerProcess()});
+        runs.add("throughput_per_joule", std::vector<double>{stats.getThroughputPerJoule()});
+        runs.add("memory_accounting", std::vector<uint64_t>{sett.MEMORY_ACCOUNTING});
+        runs.add("peak_bytes", std::vector<uint64_t>{stats.getPeakBytes()});
+        runs.add("allocations", std::vector<uint64_t>{stats.getAllocations()});
+        runs.add("stats_bytes", std::vector<uint64_t>{stats.memory.stats_bytes});
+        for(std::size_t i = 0; i < MEMORY_PART_COUNT; i++)
+            runs.add("peak_" + to_string((MemoryPart)(i)), std::vector<uint64_t>{stats.memory.parts[i].peak});
+        runs.add("throttles", std::vector<uint64_t>{stats.getThrottles()});
+        const LatencyProfile::Set& lat = stats.getLatencyProfile().all;
+        const char* metrics[4] = {"turnaround", "wait", "response", "response_adjusted"};
+        const LatencyHistogram* hists[4] = {&lat.turnaround, &lat.wait, &lat.response, &lat.response_adjusted};
+        const char* suffixes[4] = {"_p50", "_p90", "_p99", "_p999"};
+        for(int m = 0; m < 4; m++)
+            for(int i = 0; i < 4; i++)
+                runs.add(metrics[m] + std::string(suffixes[i]), std::vector<double>{hists[m]->percentile(LatencyProfile::PERCENTILES[i])});
+
+        std::vector<uint64_t> ids(stats.ps.size(), run), pid, prio, started, turnaround, wait, response, io_wait, io_service, length, preemptions, max_ready_wait, tickets, deadline, period, group;
+        std::vector<double> response_adjusted, service_rate, lateness, energy;
+        for(auto& p : stats.ps) {
+            ProcessSummary sum = p.summarize();
+            pid.push_back(p.id);
+            prio.push_back(p.prio);
+            started.push_back(p.started);
+            turnaround.push_back(sum.turnaround);
+            wait.push_back(sum.wait);
+            response.push_back(sum.response);
+            response_adjusted.push_back(sum.response_adjusted);
+            io_wait.push_back(sum.io_wait);
+            io_service.push_back(sum.io_service);
+            length.push_back(sum.length);
+            preemptions.push_back(p.preemptions);
+            max_ready_wait.push_back(sum.max_ready_wait);
+            tickets.push_back(p.tickets);
+            service_rate.push_back(ShareProfile::serviceRate(sum));
+            deadline.push_back(p.deadline);
+            period.push_back(p.period);
+            group.push_back(p.group);
+            energy.push_back(p.energy);
+            lateness.push_back(p.hasDeadline() ? (double)(sum.turnaround) - p.deadline : 0);
+        }
+        ResultsTable procs("processes");
+        procs.add("run", ids);
+        procs.add("pid", pid);
+        procs.add("prio", prio);
+        procs.add("started", started);
+        procs.add("turnaround", turnaround);
+        procs.add("wait", wait);
+        procs.add("response", response);
+        procs.add("response_adjusted", response_adjusted);
+        procs.add("io_wait", io_wait);
+        procs.add("io_service", io_service);
+        procs.add("length", length);
+        procs.add("preemptions", preemptions);
+        procs.add("max_ready_wait", max_ready_wait);
+        procs.add("tickets", tickets);
+        procs.add("service_rate", service_rate);
+        procs.add("deadline", deadline);
+        procs.add("period", period);
+        procs.add("group", group);
+        procs.add("lateness", lateness);
+        procs.add("energy", energy);
+
+        return {runs, procs};
+    }
+
+    // as above, with a run id unique to this append
+    //      each writer (process) starts from its own random 64-bit value and counts its appends, mixed by splitmix64 (a bijection)
+    //      so a writer never repeats an id, and writers on any machines only collide by a chance of about (ids written)^2 / 2^65
+    std::vector<ResultsTable> toResultsTables(const SimulationStats& stats) {
+        static const uint64_t writer = []() {
+            std::random_device rd;
+            return (uint64_t(rd()) << 32) ^ rd();
+        }();
+        static std::atomic<uint64_t> appends(0);
+        return toResultsTables(stats, splitmix64(writer + appends++));
+    }
+
+    // appends every run to a results file (one chunk per run)
+    void exportColumnar(const ManyStats& stats, std::string path) {
+        for(auto& run : stats.runs)
+            appendResults(path, toResultsTables(run));
+    }
+
+    // results.simr in the ManyStats folder
+    void exportColumnar(const ManyStats& stats) {
+        std::string folder = stats.getFolderName();
+        std::string cmd = "mkdir -p " + folder;
+        system(cmd.c_str());
+        exportColumnar(stats, folder + "/results.simr");
+    }
+}
+
+#endif
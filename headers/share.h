@@ -0,0 +1,488 @@
+// defines LotteryQueue, StrideQueue and GroupQueue, the ready queues of the proportional-share schedulers
+
+#ifndef SHARE_H
+#define SHARE_H
+
+#include "typedefs.h"
+#include "utility.h"
+#include "workload.h"
+#include <vector>
+#include <set>
+#include <queue>
+#include <string>
+#include <memory_resource>
+#include <functional>
+#include <algorithm>
+#include <limits>
+#include <cassert>
+#include <stdint.h>
+
+namespace Simulation {
+    // lottery scheduling: each take() draws a ready process with probability tickets / (tickets of every ready process)
+    //      the tickets sit in a Fenwick tree indexed by PID, so push and take are O(log n) in the highest PID seen
+    //      the draws come from a SeededRandom, so a run is reproducible
+    class LotteryQueue {
+        public:
+            using Entry = ReadyPriorityQueue<PID>::Entry;
+        private:
+            std::vector<StepSum> tree;      // 1-based, tree[i] sums the tickets of PIDs (i - lowbit(i), i]
+            std::vector<unsigned> weight;   // tickets of each ready PID (0 when not ready)
+            std::vector<Step> since;
+            std::size_t count;
+            SeededRandom rng;
+
+            // tickets are only ever added and then removed again, so unsigned wraparound leaves every sum correct
+            void add(std::size_t slot, StepSum delta) {
+                for(; slot < tree.size(); slot += slot & (0 - slot))
+                    tree[slot] += delta;
+            }
+            // capacity is kept a power of two, so tree.back() is the total and take() can descend by halves
+            void grow(std::size_t n) {
+                std::size_t cap = std::max<std::size_t>(tree.size() - 1, 16);
+                while(cap < n)
+                    cap *= 2;
+                weight.resize(cap, 0);
+                since.resize(cap, 0);
+                tree.assign(cap + 1, 0);
+                for(std::size_t i = 1; i <= cap; i++) {
+                    tree[i] += weight[i - 1];
+                    std::size_t j = i + (i & (0 - i));
+                    if(j <= cap)
+                        tree[j] += tree[i];
+                }
+            }
+        public:
+            LotteryQueue(uint64_t seed = 0) : tree(1, 0), count(0), rng(seed) {}
+
+            bool empty() const {
+                return count == 0;
+            }
+            std::size_t size() const {
+                return count;
+            }
+            StepSum totalTickets() const {
+                return tree.back();
+            }
+            // also restarts the draws from seed
+            void clear(uint64_t seed = 0) {
+                tree.assign(1, 0);
+                weight.clear();
+                since.clear();
+                count = 0;
+                rng = SeededRandom(seed);
+            }
+
+            void push(PID id, unsigned tickets, Step s) {
+                assert(tickets > 0);
+                if(id >= weight.size())
+                    grow(std::size_t(id) + 1);
+                assert(weight[id] == 0);
+                weight[id] = tickets;
+                since[id] = s;
+                add(std::size_t(id) + 1, tickets);
+                count++;
+            }
+
+            // calls f(PID) for every ready process, in PID order
+            template<class F>
+            void forEach(F f) const {
+                for(std::size_t i = 0; i < weight.size(); i++)
+                    if(weight[i] > 0)
+                        f(PID(i));
+            }
+
+            // draws and removes a ready process (only meaningful if not empty)
+            Entry take() {
+                StepSum r = rng.below(totalTickets());
+                // finds the last slot whose prefix sum is at most r, the winner is the slot after it
+                std::size_t pos = 0;
+                for(std::size_t half = tree.size() - 1; half > 0; half /= 2)
+                    if(pos + half < tree.size() && tree[pos + half] <= r) {
+                        pos += half;
+                        r -= tree[pos];
+                    }
+                PID id = pos;
+                Entry e = {id, since[id]};
+                add(pos + 1, StepSum(0) - weight[id]);
+                weight[id] = 0;
+                count--;
+                return e;
+            }
+    };
+
+    // stride scheduling: each take() removes the ready process with the lowest pass
+    //      a process's pass advances by its stride (STRIDE1 / tickets) for every step it ran, so CPU time follows the tickets deterministically
+    //      a process which was away (blocked, or new) rejoins at no lower than the last pass dispatched, so it cannot bank credit while it is not competing
+    class StrideQueue {
+        public:
+            using Entry = ReadyPriorityQueue<PID>::Entry;
+            static constexpr StepSum STRIDE1 = StepSum(1) << 20;
+        private:
+            struct Item {
+                StepSum pass;
+                uint64_t seq;   // FIFO among equal passes
+                PID id;
+                Step since;
+
+                friend bool operator>(const Item& a, const Item& b) {
+                    return a.pass != b.pass ? a.pass > b.pass : a.seq > b.seq;
+                }
+            };
+            std::vector<Item> heap;         // a min-heap by std::greater (a plain vector, so it can be walked)
+            std::vector<StepSum> passes;    // per PID
+            std::vector<StepSum> charged;   // running steps already added to each PID's pass
+            StepSum global_pass;            // pass of the last process taken
+            uint64_t seq;
+        public:
+            StrideQueue() : global_pass(0), seq(0) {}
+
+            bool empty() const {
+                return heap.empty();
+            }
+            std::size_t size() const {
+                return heap.size();
+            }
+            void clear() {
+                heap.clear();
+                passes.clear();
+                charged.clear();
+                global_pass = 0;
+                seq = 0;
+            }
+
+            // ran is the total steps the process has run so far, the steps since the last push are charged to its pass
+            void push(PID id, unsigned tickets, StepSum ran, Step s) {
+                assert(tickets > 0);
+                if(id >= passes.size()) {
+                    passes.resize(std::size_t(id) + 1, 0);
+                    charged.resize(std::size_t(id) + 1, 0);
+                }
+                passes[id] += (ran - charged[id]) * std::max<StepSum>(1, STRIDE1 / tickets);
+                charged[id] = ran;
+                passes[id] = std::max(passes[id], global_pass);
+                heap.push_back({passes[id], seq++, id, s});
+                std::push_heap(heap.begin(), heap.end(), std::greater<Item>());
+            }
+
+            // calls f(PID) for every ready process, in no particular order
+            template<class F>
+            void forEach(F f) const {
+                for(auto& it : heap)
+                    f(it.id);
+            }
+
+            // removes the process with the lowest pass (only meaningful if not empty)
+            Entry take() {
+                std::pop_heap(heap.begin(), heap.end(), std::greater<Item>());
+                Item top = heap.back();
+                heap.pop_back();
+                global_pass = top.pass;
+                return {top.id, top.since};
+            }
+
+            // a process which ran ran steps elsewhere (see System::adopt) joins at the current pass, without being charged for them
+            void join(PID id, StepSum ran) {
+                if(id >= passes.size()) {
+                    passes.resize(std::size_t(id) + 1, 0);
+                    charged.resize(std::size_t(id) + 1, 0);
+                }
+                passes[id] = 0;
+                charged[id] = ran;
+            }
+
+            // a retired PID may be reused by a new process, which starts afresh
+            void forget(PID id) {
+                if(id < passes.size())
+                    passes[id] = charged[id] = 0;
+            }
+    };
+
+    // hierarchical fair share (Scheduler::fair): the groups of SystemSettings::GROUPS form a tree, which take() walks down from the root
+    //      each group is a stride queue of its runnable children, subgroups in an inner group and processes in a leaf
+    //      a subgroup's pass advances by STRIDE1 / weight and a process's by STRIDE1 / tickets for every step they ran
+    //      and as in StrideQueue, a child which was away rejoins at no lower than the pass last taken in its parent
+    //      so push, take and charge are O(depth * log n)
+    // a group with a quota is throttled, along with its subgroups, once it has run quota steps in the current period (periods start at step 0)
+    //      CPU time is charged when a process leaves its CPU (see charge()), so a group can overrun its quota by up to a burst or quantum
+    //      the overrun is carried into the next period, which stays throttled while the debt is a whole quota
+    //      a process of a throttled group stays queued (size()) but cannot be taken (available())
+    class GroupQueue {
+        public:
+            using Entry = ReadyPriorityQueue<PID>::Entry;
+            static constexpr StepSum STRIDE1 = StrideQueue::STRIDE1;
+        private:
+            static constexpr std::size_t NO_GROUP = std::numeric_limits<std::size_t>::max();
+            struct Item {
+                StepSum pass;
+                uint64_t seq;       // FIFO among equal passes
+                std::size_t group;  // a subgroup, or NO_GROUP for a process
+                PID id;
+                Step since;
+
+                friend bool operator<(const Item& a, const Item& b) {
+                    return a.pass != b.pass ? a.pass < b.pass : a.seq < b.seq;
+                }
+            };
+            struct Group {
+                GroupSettings sett;
+                std::size_t parent;         // index of the parent (the root for a top-level group)
+                bool leaf;
+                std::pmr::set<Item> ready;  // runnable children
+                StepSum available;          // processes which could be taken through this group
+                StepSum pass;
+                uint64_t seq;               // of this group's Item in its parent
+                StepSum floor;              // pass of the child last taken
+                bool attached;              // in its parent's ready
+                bool throttled;
+                Step throttled_since;
+                StepSum used;               // steps charged in the current period (including debt carried over)
+                StepSum period;             // index of the current period
+                StepSum ran;
+                StepSum throttles;
+                StepSum throttled_steps;
+            };
+            std::pmr::memory_resource* mem;
+            std::vector<Group> groups;      // the root last
+            std::size_t root;
+            std::vector<StepSum> passes;    // per PID
+            std::vector<StepSum> charged;   // running steps already added to each PID's pass
+            std::vector<unsigned> weights;  // tickets of each PID
+            std::vector<std::size_t> group_of;
+            // (first step of a period, group) of each throttled group
+            std::priority_queue<std::pair<StepSum, std::size_t>, std::vector<std::pair<StepSum, std::size_t>>, std::greater<std::pair<StepSum, std::size_t>>> unthrottle;
+            std::size_t count;
+            uint64_t seq;
+
+            static StepSum stride(unsigned weight) {
+                return std::max<StepSum>(1, STRIDE1 / weight);
+            }
+            // processes g passes up to its parent
+            StepSum contribution(std::size_t g) const {
+                return groups[g].attached ? groups[g].available : 0;
+            }
+            // after g's available count or throttling changed (its contribution having been before):
+            //      puts g in or out of its parent's ready, and passes the change in its contribution up the tree
+            void settle(std::size_t g, StepSum before) {
+                while(g != root) {
+                    Group& gr = groups[g];
+                    Group& par = groups[gr.parent];
+                    bool in = !gr.throttled && gr.available > 0;
+                    if(in && !gr.attached) {
+                        gr.pass = std::max(gr.pass, par.floor);
+                        gr.seq = seq++;
+                        par.ready.insert({gr.pass, gr.seq, g, 0, 0});
+                    } else if(!in && gr.attached) {
+                        par.ready.erase({gr.pass, gr.seq, g, 0, 0});
+                    }
+                    gr.attached = in;
+                    StepSum after = contribution(g);
+                    if(after == before)
+                        return;
+                    StepSum par_before = contribution(gr.parent);
+                    par.available += after - before;
+                    g = gr.parent;
+                    before = par_before;
+                }
+            }
+            // moves g's usage on to the period of step s, paying off a quota per period passed
+            void roll(Group& gr, Step s) {
+                StepSum p = s / gr.sett.period;
+                if(p > gr.period) {
+                    StepSum paid = (p - gr.period) * gr.sett.quota;
+                    gr.used = gr.used > paid ? gr.used - paid : 0;
+                    gr.period = p;
+                }
+            }
+            void throttle(std::size_t g, Step s) {
+                Group& gr = groups[g];
+                StepSum before = contribution(g);
+                gr.throttled = true;
+                gr.throttled_since = s;
+                gr.throttles++;
+                unthrottle.push({(StepSum(s) / gr.sett.period + 1) * gr.sett.period, g});
+                settle(g, before);
+            }
+            void grow(PID id) {
+                if(id >= passes.size()) {
+                    passes.resize(std::size_t(id) + 1, 0);
+                    charged.resize(std::size_t(id) + 1, 0);
+                    weights.resize(std::size_t(id) + 1, 1);
+                    group_of.resize(std::size_t(id) + 1, 0);
+                }
+            }
+        public:
+            GroupQueue(std::pmr::memory_resource* mm = std::pmr::get_default_resource()) : mem(mm), root(0), count(0), seq(0) {
+                configure({});
+            }
+
+            // replaces the groups (and empties the queue), empty gs meaning one group
+            void configure(const std::vector<GroupSettings>& gs) {
+                clear();
+                groups.clear();
+                std::vector<GroupSettings> all = gs.empty() ? std::vector<GroupSettings>(1) : gs;
+                root = all.size();
+                for(std::size_t i = 0; i <= root; i++) {
+                    GroupSettings sett = i < root ? all[i] : GroupSettings();
+                    if(i < root && sett.parent != GroupSettings::ROOT && sett.parent >= i)
+                        throw "Group " + std::to_string(i) + " must come after its parent " + std::to_string(sett.parent);
+                    if(sett.weight == 0 || (sett.quota > 0 && sett.period == 0))
+                        throw "Bad weight or period for group " + std::to_string(i);
+                    groups.push_back(Group{sett, sett.parent == GroupSettings::ROOT ? root : sett.parent, i < root, std::pmr::set<Item>(mem), 0, 0, 0, 0, false, false, 0, 0, 0, 0, 0, 0});
+                    if(i < root && sett.parent != GroupSettings::ROOT)
+                        groups[sett.parent].leaf = false;
+                }
+            }
+
+            bool empty() const {
+                return count == 0;
+            }
+            // every queued process, throttled or not
+            std::size_t size() const {
+                return count;
+            }
+            // the queued processes take() could return
+            std::size_t available() const {
+                return groups[root].available;
+            }
+            // the groups, the root excluded
+            std::size_t groupCount() const {
+                return root;
+            }
+            bool isLeaf(std::size_t g) const {
+                return g < root && groups[g].leaf;
+            }
+            // steps run by g's processes and its subgroups' processes
+            StepSum getRan(std::size_t g) const {
+                return groups.at(g).ran;
+            }
+            StepSum getThrottles(std::size_t g) const {
+                return groups.at(g).throttles;
+            }
+            // steps g spent throttled up to step s
+            StepSum getThrottledSteps(std::size_t g, Step s) const {
+                const Group& gr = groups.at(g);
+                return gr.throttled_steps + (gr.throttled && s > gr.throttled_since ? s - gr.throttled_since : 0);
+            }
+
+            // keeps the groups
+            void clear() {
+                for(auto& gr : groups) {
+                    gr.ready.clear();
+                    gr.available = gr.pass = gr.floor = gr.used = gr.period = gr.ran = gr.throttles = gr.throttled_steps = 0;
+                    gr.seq = 0;
+                    gr.attached = gr.throttled = false;
+                    gr.throttled_since = 0;
+                }
+                passes.clear();
+                charged.clear();
+                weights.clear();
+                group_of.clear();
+                unthrottle = decltype(unthrottle)();
+                count = 0;
+                seq = 0;
+            }
+
+            // group must be a leaf
+            void push(PID id, std::size_t group, unsigned tickets, Step s) {
+                assert(tickets > 0 && isLeaf(group));
+                grow(id);
+                weights[id] = tickets;
+                group_of[id] = group;
+                Group& gr = groups[group];
+                passes[id] = std::max(passes[id], gr.floor);
+                StepSum before = contribution(group);
+                gr.ready.insert({passes[id], seq++, NO_GROUP, id, s});
+                gr.available++;
+                count++;
+                settle(group, before);
+            }
+
+            // calls f(PID) for every queued process, in no particular order
+            template<class F>
+            void forEach(F f) const {
+                for(auto& gr : groups)
+                    for(auto& it : gr.ready)
+                        if(it.group == NO_GROUP)
+                            f(it.id);
+            }
+
+            // removes the process reached by following the lowest pass down from the root (only meaningful if available())
+            Entry take() {
+                std::size_t g = root;
+                for(;;) {
+                    Group& gr = groups[g];
+                    Item top = *gr.ready.begin();
+                    gr.floor = top.pass;
+                    if(top.group != NO_GROUP) {
+                        g = top.group;
+                        continue;
+                    }
+                    StepSum before = contribution(g);
+                    gr.ready.erase(gr.ready.begin());
+                    gr.available--;
+                    count--;
+                    settle(g, before);
+                    return {top.id, top.since};
+                }
+            }
+
+            // a process (pushed before) which left its CPU at step s, having run ran steps in total
+            //      the steps since its last charge advance its pass, its groups' passes, and count against its groups' quotas
+            void charge(PID id, StepSum ran, Step s) {
+                StepSum delta = ran - charged[id];
+                charged[id] = ran;
+                if(delta == 0)
+                    return;
+                passes[id] += delta * stride(weights[id]);
+                for(std::size_t g = group_of[id]; g != root; g = groups[g].parent) {
+                    Group& gr = groups[g];
+                    Group& par = groups[gr.parent];
+                    if(gr.attached)
+                        par.ready.erase({gr.pass, gr.seq, g, 0, 0});
+                    gr.pass += delta * stride(gr.sett.weight);
+                    if(gr.attached)
+                        par.ready.insert({gr.pass, gr.seq, g, 0, 0});
+                    gr.ran += delta;
+                    if(gr.sett.quota > 0) {
+                        roll(gr, s);
+                        gr.used += delta;
+                        if(!gr.throttled && gr.used >= gr.sett.quota)
+                            throttle(g, s);
+                    }
+                }
+            }
+
+            // ends the throttling of every group whose quota is available again at step s
+            void refill(Step s) {
+                while(!unthrottle.empty() && unthrottle.top().first <= s) {
+                    std::size_t g = unthrottle.top().second;
+                    unthrottle.pop();
+                    Group& gr = groups[g];
+                    roll(gr, s);
+                    if(gr.used >= gr.sett.quota) {
+                        unthrottle.push({(StepSum(s) / gr.sett.period + 1) * gr.sett.period, g});
+                        continue;
+                    }
+                    StepSum before = contribution(g);
+                    gr.throttled = false;
+                    gr.throttled_steps += s - gr.throttled_since;
+                    settle(g, before);
+                }
+            }
+
+            // a process which ran ran steps elsewhere (see System::adopt) joins at its group's current pass, without being charged for them
+            void join(PID id, StepSum ran) {
+                grow(id);
+                passes[id] = 0;
+                charged[id] = ran;
+            }
+
+            // a retired PID may be reused by a new process, which starts afresh
+            void forget(PID id) {
+                if(id < passes.size())
+                    passes[id] = charged[id] = 0;
+            }
+    };
+}
+
+#endif
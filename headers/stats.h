@@ -5,21 +5,68 @@
 
 #include "typedefs.h"
 #include "process_utils.h"
+#include "histogram.h"
+#include "memory.h"
+#include <memory_resource>
 #include <iostream>
 #include <iomanip>
 #include <vector>
 #include <list>
+#include <map>
 #include <string>
 #include <sstream>
 #include <fstream>
 #include <numeric>
 #include <algorithm>
 #include <stdint.h>
+#include <limits>
+#include <optional>
+#include <thread>
+#include <atomic>
 
 namespace Simulation {
+    // the period encoding shared by History and CompressedTrace (see trace.h)
+    //      the first byte holds the state in bits 0-2, the low 4 bits of the duration in bits 3-6 and a continuation flag in bit 7
+    //      further bytes hold 7 more bits of the duration each (LEB128), so a typical period takes 1-2 bytes instead of 8
+    const std::size_t PERIOD_STATE_BITS = 3;
+
+    template<typename E, class Bytes>
+    void encodePeriod(Bytes& bytes, E state, StepSum d) {
+        uint8_t b = static_cast<uint8_t>(state) | ((d & 0xF) << PERIOD_STATE_BITS);
+        d >>= 4;
+        if(d)
+            b |= 0x80;
+        bytes.push_back(b);
+        while(d) {
+            b = d & 0x7F;
+            d >>= 7;
+            if(d)
+                b |= 0x80;
+            bytes.push_back(b);
+        }
+    }
+    // decodes the period at offset pos of bytes, advancing pos past it
+    template<typename E>
+    std::pair<E, StepSum> decodePeriod(const uint8_t* bytes, uint64_t& pos) {
+        uint8_t b = bytes[pos++];
+        E state = static_cast<E>(b & ((1 << PERIOD_STATE_BITS) - 1));
+        StepSum d = (b >> PERIOD_STATE_BITS) & 0xF;
+        int shift = 4;
+        while(b & 0x80) {
+            b = bytes[pos++];
+            d |= StepSum(b & 0x7F) << shift;
+            shift += 7;
+        }
+        return {state, d};
+    }
+
+    // the periods a process or CPU spent in each state, in order
+    //      the latest periods are kept as they are, so pushing one stays cheap
+    //      every SEAL_INTERVAL periods the older ones are sealed into the packed encoding above, so a long History takes 1-2 bytes a period
+    //      the sealed part is only allocated on the first seal, so a short History costs what a plain vector of its periods would
     template <typename E>
     class History {
-        private:
+        public:
             struct Period {
                 E state;
                 Step duration;
@@ -29,33 +76,173 @@ namespace Simulation {
                     return *this;
                 }
             };
+            static constexpr std::size_t SEAL_INTERVAL = 64;
 
-            std::vector<Period> trace;
+            // walks the sealed periods, decoding them one at a time, then the live ones
+            //      a reference to a period is only good until the iterator moves
+            class const_iterator {
+                private:
+                    const History* h;
+                    uint64_t offset;    // of the current period in the sealed bytes, sealedSize() once in the tail
+                    std::size_t i;      // of the current period in tail
+                    uint64_t next;      // offset of the sealed period after the current one
+                    Period current;
+
+                    void load() {
+                        if(offset < h->sealedSize()) {
+                            next = offset;
+                            auto p = decodePeriod<E>(h->sealed->bytes.data(), next);
+                            current = {p.first, Step(p.second)};
+                        } else if(i < h->tail.size()) {
+                            current = h->tail[i];
+                        }
+                    }
+                public:
+                    using iterator_category = std::forward_iterator_tag;
+                    using value_type = Period;
+                    using difference_type = std::ptrdiff_t;
+                    using pointer = const Period*;
+                    using reference = const Period&;
+
+                    const_iterator(const History* hh, uint64_t oo, std::size_t ii) : h(hh), offset(oo), i(ii), next(oo) {
+                        load();
+                    }
+                    reference operator*() const {
+                        return current;
+                    }
+                    pointer operator->() const {
+                        return &current;
+                    }
+                    const_iterator& operator++() {
+                        if(offset < h->sealedSize())
+                            offset = next;
+                        else
+                            i++;
+                        load();
+                        return *this;
+                    }
+                    const_iterator operator++(int) {
+                        const_iterator out = *this;
+                        ++*this;
+                        return out;
+                    }
+                    bool operator==(const const_iterator& other) const {
+                        return offset == other.offset && i == other.i;
+                    }
+                    bool operator!=(const const_iterator& other) const {
+                        return !(*this == other);
+                    }
+            };
+        private:
+            struct Sealed {
+                std::pmr::vector<uint8_t> bytes;
+                std::size_t periods;
+                StepSum steps;
+            };
+
+            std::pmr::vector<Period> tail;      // the periods since the last seal, the last one still growing
+            Sealed* sealed;                     // from the tail's memory resource, nullptr until the first seal
+
+            std::size_t sealedSize() const {
+                return sealed ? sealed->bytes.size() : 0;
+            }
+            // allocates the sealed part from the tail's resource, copying from's (if any)
+            void makeSealed(const Sealed* from) {
+                std::pmr::polymorphic_allocator<Sealed> alloc(tail.get_allocator().resource());
+                Sealed* out = alloc.allocate(1);
+                try {
+                    if(from)
+                        new (out) Sealed{std::pmr::vector<uint8_t>(from->bytes, alloc.resource()), from->periods, from->steps};
+                    else
+                        new (out) Sealed{std::pmr::vector<uint8_t>(alloc.resource()), 0, 0};
+                } catch(...) {
+                    alloc.deallocate(out, 1);
+                    throw;
+                }
+                sealed = out;
+            }
+            void releaseSealed() {
+                if(!sealed)
+                    return;
+                std::pmr::polymorphic_allocator<Sealed> alloc(tail.get_allocator().resource());
+                sealed->~Sealed();
+                alloc.deallocate(sealed, 1);
+                sealed = nullptr;
+            }
+
+            // packs all but the last period of the tail (which may still grow)
+            void seal() {
+                if(!sealed)
+                    makeSealed(nullptr);
+                for(std::size_t k = 0; k + 1 < tail.size(); k++) {
+                    encodePeriod(sealed->bytes, tail[k].state, tail[k].duration);
+                    sealed->steps += tail[k].duration;
+                }
+                sealed->periods += tail.size() - 1;
+                tail.erase(tail.begin(), tail.end() - 1);
+            }
         public:
-            History() {}
+            using allocator_type = std::pmr::polymorphic_allocator<std::byte>;
 
-            std::vector<Period> getTrace() const {
-                return trace;
+            History(const allocator_type& alloc = {}) : tail(alloc), sealed(nullptr) {}
+            History(const History& other) : tail(other.tail), sealed(nullptr) {
+                if(other.sealed)
+                    makeSealed(other.sealed);
+            }
+            History(const History& other, const allocator_type& alloc) : tail(other.tail, alloc), sealed(nullptr) {
+                if(other.sealed)
+                    makeSealed(other.sealed);
+            }
+            History& operator=(const History& other) {
+                if(this == &other)
+                    return *this;
+                tail = other.tail;
+                if(!other.sealed) {
+                    releaseSealed();
+                } else if(sealed) {
+                    sealed->bytes = other.sealed->bytes;
+                    sealed->periods = other.sealed->periods;
+                    sealed->steps = other.sealed->steps;
+                } else {
+                    makeSealed(other.sealed);
+                }
+                return *this;
             }
-            typename std::vector<Period>::const_iterator cbegin() const {
-                return trace.cbegin();
+            ~History() {
+                releaseSealed();
+            }
+
+            const_iterator cbegin() const {
+                return const_iterator(this, 0, 0);
             }
-            typename std::vector<Period>::const_iterator cend() const {
-                return trace.cend();
+            const_iterator cend() const {
+                return const_iterator(this, sealedSize(), tail.size());
             }
-            typename std::vector<Period>::const_iterator begin() const {
+            const_iterator begin() const {
                 return cbegin();
             }
-            typename std::vector<Period>::const_iterator end() const {
+            const_iterator end() const {
                 return cend();
             }
+            // number of periods stored
+            std::size_t size() const {
+                return (sealed ? sealed->periods : 0) + tail.size();
+            }
+            // bytes held on the heap
+            std::size_t heapBytes() const {
+                return (sealed ? sizeof(Sealed) + sealed->bytes.capacity() : 0) + tail.capacity() * sizeof(Period);
+            }
 
             void push(E state, Step duration) {
-                if(trace.empty() || trace.back().state != state) {
+                // a period which would overflow Step is continued in a new one
+                if(tail.empty() || tail.back().state != state || tail.back().duration > std::numeric_limits<Step>::max() - duration) {
+                    // sealed before the tail outgrows SEAL_INTERVAL, so its capacity never does
+                    if(tail.size() == SEAL_INTERVAL)
+                        seal();
                     Period p = {state, duration};
-                    trace.push_back(p);
+                    tail.push_back(p);
                 } else {
-                    trace.back() += duration;
+                    tail.back() += duration;
                 }
             }
 
@@ -63,20 +250,29 @@ namespace Simulation {
                 push(state, 1);
             }
 
-            /**/Step duration() const {
+            // pushes a total which may not fit in a Step, as many periods of it as it takes
+            void pushSum(E state, StepSum duration) {
+                do {
+                    Step d = Step(std::min<StepSum>(duration, std::numeric_limits<Step>::max()));
+                    push(state, d);
+                    duration -= d;
+                } while(duration > 0);
+            }
+
+            StepSum duration() const {
                 return std::accumulate(
-                    trace.cbegin(), trace.cend(), /**/Step(0), 
-                    [](/**/Step sum, Period p) {
+                    tail.cbegin(), tail.cend(), sealed ? sealed->steps : StepSum(0), 
+                    [](StepSum sum, Period p) {
                         return sum + p.duration;
                     }
                 );
             }
 
             // get duration of particular state
-            /**/Step duration(E state) const {
+            StepSum duration(E state) const {
                 return std::accumulate(
-                    trace.cbegin(), trace.cend(), /**/Step(0), 
-                    [state](/**/Step sum, Period p) {
+                    cbegin(), cend(), StepSum(0), 
+                    [state](StepSum sum, const Period& p) {
                         return p.state == state ? sum + p.duration : sum;
                     }
                 );
@@ -84,7 +280,7 @@ namespace Simulation {
 
             void print(int indent = 0) const {
                 std::string ind(indent, ' ');
-                for(auto& p : trace)
+                for(auto& p : *this)
                     std::cout << ind << to_string(p.state) << ": " << p.duration << std::endl;
             }
 
@@ -94,17 +290,17 @@ namespace Simulation {
                 double d = duration();
                 // get max length of enum strings
                 int max = 0;
-                for(auto& p : trace)
+                for(auto& p : *this)
                     max = std::max(max, (int)(to_string(p.state).length()));
                 // output
-                for(auto& p : trace)
+                for(auto& p : *this)
                     std::cout << std::setprecision(5) << ind << to_string(p.state) << ": " << std::string(max - to_string(p.state).length(), ' ') << 100 * p.duration / d << "%" << std::endl;
             }
 
             std::string to_timeline_csv() const {
                 std::ostringstream out_s;
                 out_s << "state,duration" << std::endl;
-                for(auto& t : trace)
+                for(auto& t : *this)
                     out_s << to_string(t.state) << "," << t.duration << std::endl;
 
                 return out_s.str();
@@ -122,37 +318,77 @@ namespace Simulation {
     };
 
     // collapse a set of Historys into sums of states
+    //      the sums are StepSums, as the Historys of many CPUs can add up past a Step, and a sum beyond one is split over several periods
     // final argument is a hint for the templating deduction
     template<typename E, typename iterator_type>
     History<E> collapseSums(iterator_type start, iterator_type end, E) {
         // calculate sums
-        std::map<E, Step> sums;
+        std::map<E, StepSum> sums;
         while(start != end)
-            for(auto& t : (*(start++)).getTrace())
+            for(auto& t : *(start++))
                 sums[t.state] += t.duration;
         
         History<E> out;
         for(auto& s : sums)
-            out.push(s.first, s.second);
+            out.pushSum(s.first, s.second);
         return out;
     }
 
     template<typename E>
     History<E> collapseSums(History<E> source) {
         if(source.begin() != source.end())
-            return collapseSums(&source, &source + 1, source.getTrace().front().state);
+            return collapseSums(&source, &source + 1, (*source.begin()).state);
         return History<E>();
     }
 
+    const std::size_t PROCESS_STATE_COUNT = 6;
+
+    // every per-process metric, gathered in one walk over the history
+    struct ProcessSummary {
+        StepSum turnaround = 0;
+        StepSum wait = 0;
+        StepSum response = 0;
+        StepSum io_wait = 0;
+        StepSum io_service = 0;
+        StepSum length = 0;             // total steps in the plan
+        StepSum cpu_length = 0;         // steps of CPU bursts in the plan
+        double response_adjusted = 0;
+        StepSum max_ready_wait = 0;     // longest single stretch in the ready queue
+        StepSum states[PROCESS_STATE_COUNT] = {};     // duration of each ProcessState, indexed by the enum
+        unsigned seen = 0;              // bit per ProcessState which occurs in the history
+    };
+
     // stats tracked per Process
     struct ProcessStats {
         const PID id;
         const Priority prio;
         Step started;
-        ProcessBursts plan;
+        BurstSummary plan;              // of every burst the process has had (for a lazy process, only those drawn so far)
         History<ProcessState> hist;
+        StepSum preemptions = 0;        // times the process lost its CPU to a higher-priority one
+        unsigned tickets;               // weight under the proportional-share schedulers
+        Step deadline;                  // relative to arrival (0: none)
+        Step period;                    // of the periodic task the process is a job of (0: none)
+        std::size_t group;              // scheduling group under Scheduler::fair
+        double energy = 0;              // joules of the CPUs while they held this process (idle CPUs are not charged to anyone)
+
+        using allocator_type = std::pmr::polymorphic_allocator<std::byte>;
 
-        ProcessStats(const ProcessInit& pi, Step s, History<ProcessState> h) : id(pi.id), prio(pi.prio), started(s), plan(pi.bursts), hist(h) {}
+        ProcessStats(const ProcessInit& pi, Step s, const allocator_type& alloc = {}) : id(pi.id), prio(pi.prio), started(s), plan(pi.bursts.summarize()), hist(alloc), tickets(ticketsFor(pi)), deadline(pi.deadline), period(pi.period), group(pi.group) {}
+        ProcessStats(const ProcessStats& other) = default;
+        ProcessStats(const ProcessStats& other, const allocator_type& alloc) : id(other.id), prio(other.prio), started(other.started), plan(other.plan), hist(other.hist, alloc), preemptions(other.preemptions), tickets(other.tickets), deadline(other.deadline), period(other.period), group(other.group), energy(other.energy) {}
+
+        bool hasDeadline() const {
+            return deadline > 0;
+        }
+        // absolute deadline, in the steps of the simulation
+        StepSum getDue() const {
+            return StepSum(started) + deadline;
+        }
+        // finishing time past the deadline (negative when early)
+        double getLateness() const {
+            return (double)(hist.duration()) - deadline;
+        }
 
         // Total time in history (ready + processing + blocked)
         Step getTurnaround() const {
@@ -164,13 +400,23 @@ namespace Simulation {
             return hist.duration(ProcessState::ready) + hist.duration(ProcessState::switching) + hist.duration(ProcessState::exit);
         }
 
+        // Time queued for a busy IO device
+        Step getIOWait() const {
+            return hist.duration(ProcessState::io_waiting);
+        }
+
+        // Time being served by IO
+        Step getIOService() const {
+            return hist.duration(ProcessState::blocked);
+        }
+
         // Max time between IO
         Step getResponse() const {
             Step max = 0;
             Step cur = 0;
             auto end = hist.cend();
             for(auto it = hist.cbegin(); it != end; it++) {
-                if((*it).state == ProcessState::blocked) {
+                if((*it).state == ProcessState::blocked || (*it).state == ProcessState::io_waiting) {
                     max = std::max(max, cur);
                     cur = 0;
                 } else {
@@ -186,27 +432,57 @@ namespace Simulation {
             // can't adjust perfect response
             if(resp == 0) 
                 return 0;
-            
-            bool p = plan.isProcessing();
-            Step max_burst = 0; 
-            for(auto it = plan.cbegin(); it != plan.cend(); it++) {
-                // toggle processing and only go for processing
-                if(!(p = !p)) {
-                    max_burst = std::max(max_burst, *it);
+            return (double)(resp) / (double)(plan.max_cpu_burst);
+        }
+
+        // the getters above in a single pass
+        ProcessSummary summarize() const {
+            ProcessSummary out;
+            Step cur = 0;
+            for(auto& t : hist) {
+                unsigned st = (unsigned)(t.state);
+                out.states[st] += t.duration;
+                out.seen |= 1u << st;
+                out.turnaround += t.duration;
+                if(t.state == ProcessState::ready)
+                    out.max_ready_wait = std::max<StepSum>(out.max_ready_wait, t.duration);
+                if(t.state == ProcessState::blocked || t.state == ProcessState::io_waiting) {
+                    out.response = std::max<StepSum>(out.response, cur);
+                    cur = 0;
+                } else {
+                    cur += t.duration;
                 }
             }
-            return (double)(resp) / (double)(max_burst);
+            out.wait = out.states[(unsigned)(ProcessState::ready)] + out.states[(unsigned)(ProcessState::switching)] + out.states[(unsigned)(ProcessState::exit)];
+            out.io_wait = out.states[(unsigned)(ProcessState::io_waiting)];
+            out.io_service = out.states[(unsigned)(ProcessState::blocked)];
+
+            out.length = plan.length;
+            out.cpu_length = plan.cpu_length;
+            if(out.response != 0)
+                out.response_adjusted = (double)(out.response) / (double)(plan.max_cpu_burst);
+            return out;
         }
 
         void print(int indent = 0) const {
             std::string ind(indent, ' ');
             std::cout << ind << "PCB " << id << std::endl;
             std::cout << ind << "    priority: " << (int)(prio) << std::endl;
+            std::cout << ind << "    tickets: " << tickets << std::endl;
+            if(hasDeadline())
+                std::cout << ind << "    deadline: " << deadline << " (lateness " << getLateness() << ")" << std::endl;
+            if(period > 0)
+                std::cout << ind << "    period: " << period << std::endl;
+            std::cout << ind << "    energy: " << energy << " J" << std::endl;
             std::cout << ind << "    turnaround: " << getTurnaround() << std::endl;
             std::cout << ind << "    wait: " << getWait() << std::endl;
             std::cout << ind << "    response: " << getResponse() << std::endl;
             std::cout << ind << "       (adjusted): " << std::setprecision(5) << getResponseAdjusted() << std::endl;
+            std::cout << ind << "    io wait: " << getIOWait() << std::endl;
+            std::cout << ind << "    io service: " << getIOService() << std::endl;
             std::cout << ind << "    started: " << started << std::endl;
+            if(preemptions > 0)
+                std::cout << ind << "    preemptions: " << preemptions << std::endl;
             std::cout << ind << "    hist: " << std::endl;   hist.print(indent+8);
         }
     };
@@ -215,6 +491,15 @@ namespace Simulation {
     struct CPUStats {
         CPUID id;
         History<CPUState> hist;
+        unsigned speed = 100;           // percent of base speed
+        StepSum switches_in = 0;
+        StepSum warm_switches = 0;      // the incoming process was the last to run here
+        StepSum migrations = 0;         // the incoming process last ran on another CPU
+        StepSum preemptions = 0;        // a running process was switched out for a higher-priority one
+        double energy = 0;              // joules
+        StepSum slept = 0;              // idle steps spent in the sleep state
+        StepSum wakeups = 0;            // processes switched in on a sleeping CPU
+        StepSum frequency_changes = 0;  // P-state changes made by the governor
 
         double getStatePercent(CPUState state) const {
             return hist.duration(state) / (double)(hist.duration());
@@ -228,50 +513,522 @@ namespace Simulation {
             std::cout << ind << "    Idle:          " << 100*getStatePercent(CPUState::idle) << "%" << std::endl;
             std::cout << ind << "    Switching In:  " << 100*getStatePercent(CPUState::switching_in) << "%" << std::endl;
             std::cout << ind << "    Switching Out: " << 100*getStatePercent(CPUState::switching_out) << "%" << std::endl;
+            if(speed != 100)
+                std::cout << ind << "    Speed:         " << speed << "%" << std::endl;
+            std::cout << ind << "    Switches In:   " << switches_in << " (" << warm_switches << " warm, " << migrations << " migrations)" << std::endl;
+            if(preemptions > 0)
+                std::cout << ind << "    Preemptions:   " << preemptions << std::endl;
+            std::cout << ind << "    Energy:        " << energy << " J" << std::endl;
+            if(slept > 0)
+                std::cout << ind << "    Slept:         " << slept << " Steps (" << wakeups << " wakeups)" << std::endl;
+            if(frequency_changes > 0)
+                std::cout << ind << "    P-state Changes: " << frequency_changes << std::endl;
+        }
+    };
+
+    // stats tracked per scheduling group under Scheduler::fair, each including its subgroups
+    struct GroupStats {
+        std::size_t id;
+        StepSum ran = 0;                // CPU steps run by the group's processes
+        StepSum throttles = 0;          // times the group used up its quota
+        StepSum throttled = 0;          // steps spent throttled
+    };
+
+    // latency distributions over a set of processes, overall and per priority
+    // fixed memory per histogram, and mergeable, so the distributions of many runs can be pooled
+    struct LatencyProfile {
+        struct Set {
+            LatencyHistogram turnaround;
+            LatencyHistogram wait;
+            LatencyHistogram response;
+            LatencyHistogram response_adjusted;     // a ratio, kept to three decimals
+            StepSum max_ready_wait = 0;             // starvation: the longest any process waited in the ready queue at once
+
+            Set() : response_adjusted(0.001) {}
+
+            void record(const ProcessSummary& p) {
+                turnaround.record(p.turnaround);
+                wait.record(p.wait);
+                response.record(p.response);
+                response_adjusted.record(p.response_adjusted);
+                max_ready_wait = std::max(max_ready_wait, p.max_ready_wait);
+            }
+            Set& merge(const Set& other) {
+                turnaround.merge(other.turnaround);
+                wait.merge(other.wait);
+                response.merge(other.response);
+                response_adjusted.merge(other.response_adjusted);
+                max_ready_wait = std::max(max_ready_wait, other.max_ready_wait);
+                return *this;
+            }
+        };
+
+        static constexpr double PERCENTILES[4] = {50, 90, 99, 99.9};
+
+        Set all;
+        std::vector<Set> by_prio;
+
+        LatencyProfile() : by_prio(MAX_PRIO) {}
+
+        void record(Priority prio, const ProcessSummary& p) {
+            all.record(p);
+            if(prio >= by_prio.size())
+                by_prio.resize(prio + 1);
+            by_prio[prio].record(p);
+        }
+        void record(const ProcessStats& p) {
+            record(p.prio, p.summarize());
+        }
+        LatencyProfile& merge(const LatencyProfile& other) {
+            all.merge(other.all);
+            if(other.by_prio.size() > by_prio.size())
+                by_prio.resize(other.by_prio.size());
+            for(std::size_t i = 0; i < other.by_prio.size(); i++)
+                by_prio[i].merge(other.by_prio[i]);
+            return *this;
+        }
+
+        // Turnaround p50,...,Response Adjusted p999
+        static std::string to_csv_header() {
+            std::string out;
+            for(std::string metric : {"Turnaround", "Wait", "Response", "Response Adjusted"})
+                for(std::string p : {"p50", "p90", "p99", "p999"})
+                    out += (out.empty() ? "" : ",") + metric + " " + p;
+            return out;
+        }
+        static std::string to_csv_row(const Set& s) {
+            std::ostringstream out;
+            out << std::setprecision(5);
+            bool first = true;
+            for(const LatencyHistogram* h : {&s.turnaround, &s.wait, &s.response, &s.response_adjusted})
+                for(double p : PERCENTILES) {
+                    out << (first ? "" : ",") << h->percentile(p);
+                    first = false;
+                }
+            return out.str();
+        }
+
+        // one row per priority (plus one for all processes)
+        std::string to_csv() const {
+            std::ostringstream out;
+            out << "Priority,Count," << to_csv_header() << ",Max Ready Wait" << std::endl;
+            out << "all," << all.turnaround.count() << "," << to_csv_row(all) << "," << all.max_ready_wait << std::endl;
+            for(std::size_t i = 0; i < by_prio.size(); i++)
+                if(by_prio[i].turnaround.count() > 0)
+                    out << (int)(i) << "," << by_prio[i].turnaround.count() << "," << to_csv_row(by_prio[i]) << "," << by_prio[i].max_ready_wait << std::endl;
+            return out.str();
+        }
+
+        void print(int indent = 0) const {
+            std::string ind(indent, ' ');
+            std::cout << std::setprecision(5);
+            std::cout << ind << "              p50 / p90 / p99 / p99.9" << std::endl;
+            const char* names[4] = {"Turnaround: ", "Wait:       ", "Response:   ", "  (adjusted)"};
+            const LatencyHistogram* hs[4] = {&all.turnaround, &all.wait, &all.response, &all.response_adjusted};
+            for(int m = 0; m < 4; m++) {
+                std::cout << ind << names[m] << "  ";
+                for(int i = 0; i < 4; i++)
+                    std::cout << (i == 0 ? "" : " / ") << hs[m]->percentile(PERCENTILES[i]);
+                std::cout << std::endl;
+            }
+            std::cout << ind << "p99 Turnaround / Max Ready Wait by Priority:" << std::endl;
+            for(std::size_t i = 0; i < by_prio.size(); i++)
+                if(by_prio[i].turnaround.count() > 0)
+                    std::cout << ind << "    " << (int)(i) << ": " << by_prio[i].turnaround.percentile(99) << " / " << by_prio[i].max_ready_wait << " (" << by_prio[i].turnaround.count() << " processes)" << std::endl;
+        }
+    };
+
+    // achieved versus target share of the CPU, overall and per priority class
+    //      target: the fraction of all tickets held
+    //      achieved: the fraction of the summed service rates, a process's rate being the part of its runnable time (ready, switching or running) spent running
+    //      every process eventually runs its whole plan, so shares of running time alone would not depend on the scheduler
+    //      the rates only follow the tickets while processes compete for the CPUs, a lightly loaded system serves everyone at close to 1
+    struct ShareProfile {
+        struct Class {
+            StepSum count = 0;
+            StepSum tickets = 0;
+            double rate = 0;
+
+            Class& merge(const Class& other) {
+                count += other.count;
+                tickets += other.tickets;
+                rate += other.rate;
+                return *this;
+            }
+        };
+
+        static double serviceRate(const ProcessSummary& sum) {
+            StepSum running = sum.states[(unsigned)(ProcessState::running)];
+            StepSum runnable = running + sum.states[(unsigned)(ProcessState::ready)] + sum.states[(unsigned)(ProcessState::switching)];
+            return runnable == 0 ? 0 : running / (double)(runnable);
+        }
+
+        Class all;
+        std::vector<Class> by_prio;
+
+        ShareProfile() : by_prio(MAX_PRIO) {}
+
+        void record(Priority prio, unsigned tickets, const ProcessSummary& sum) {
+            Class c = {1, tickets, serviceRate(sum)};
+            all.merge(c);
+            if(prio >= by_prio.size())
+                by_prio.resize(prio + 1);
+            by_prio[prio].merge(c);
+        }
+        void record(const ProcessStats& p) {
+            record(p.prio, p.tickets, p.summarize());
+        }
+        ShareProfile& merge(const ShareProfile& other) {
+            all.merge(other.all);
+            if(other.by_prio.size() > by_prio.size())
+                by_prio.resize(other.by_prio.size());
+            for(std::size_t i = 0; i < other.by_prio.size(); i++)
+                by_prio[i].merge(other.by_prio[i]);
+            return *this;
+        }
+
+        double target(StepSum tickets) const {
+            return all.tickets == 0 ? 0 : tickets / (double)(all.tickets);
+        }
+        double achieved(double rate) const {
+            return all.rate == 0 ? 0 : rate / all.rate;
+        }
+        // total variation distance between the achieved and target shares of the priority classes (0: exact, 1: disjoint)
+        double error() const {
+            double out = 0;
+            for(auto& c : by_prio)
+                out += std::abs(achieved(c.rate) - target(c.tickets));
+            return out / 2;
+        }
+
+        // one row per priority
+        std::string to_csv() const {
+            std::ostringstream out;
+            out << std::setprecision(5);
+            out << "Priority,Count,Tickets,Target Share,Achieved Share" << std::endl;
+            for(std::size_t i = 0; i < by_prio.size(); i++)
+                if(by_prio[i].count > 0)
+                    out << (int)(i) << "," << by_prio[i].count << "," << by_prio[i].tickets << "," << target(by_prio[i].tickets) << "," << achieved(by_prio[i].rate) << std::endl;
+            return out.str();
+        }
+
+        void print(int indent = 0) const {
+            std::string ind(indent, ' ');
+            std::cout << std::setprecision(5);
+            std::cout << ind << "Target / Achieved by Priority:" << std::endl;
+            for(std::size_t i = 0; i < by_prio.size(); i++)
+                if(by_prio[i].count > 0)
+                    std::cout << ind << "    " << (int)(i) << ": " << 100 * target(by_prio[i].tickets) << "% / " << 100 * achieved(by_prio[i].rate) << "%" << std::endl;
+            std::cout << ind << "Share Error:    " << error() << std::endl;
+        }
+    };
+
+    // deadline misses and lateness of the processes which have a deadline, and the demand they put on the CPUs
+    //      lateness = turnaround - deadline, tardiness = max(0, lateness)
+    //      a job's density is its CPU demand over min(deadline, period), and the demand is the summed CPU steps over the span from the first arrival to the last deadline
+    //      global EDF on m identical CPUs meets every deadline of a sporadic task set whose total density is at most m - (m-1) * (largest density) (Goossens, Funk and Baruah)
+    //      the span-based demand stands in for the task set's total density, so the bound is an indication rather than a proof for one run
+    struct DeadlineProfile {
+        StepSum count = 0;
+        StepSum misses = 0;
+        double lateness = 0;                // summed
+        double max_lateness = -std::numeric_limits<double>::infinity();
+        LatencyHistogram tardiness;
+        StepSum demand = 0;
+        StepSum first = std::numeric_limits<StepSum>::max();
+        StepSum last = 0;
+        double max_density = 0;
+
+        void record(const ProcessStats& p, const ProcessSummary& sum) {
+            if(!p.hasDeadline())
+                return;
+            double late = (double)(sum.turnaround) - p.deadline;
+            count++;
+            if(late > 0)
+                misses++;
+            lateness += late;
+            max_lateness = std::max(max_lateness, late);
+            tardiness.record(std::max(0.0, late));
+            demand += sum.cpu_length;
+            first = std::min<StepSum>(first, p.started);
+            last = std::max<StepSum>(last, p.getDue());
+            Step window = p.period > 0 ? std::min(p.deadline, p.period) : p.deadline;
+            max_density = std::max(max_density, sum.cpu_length / (double)(window));
+        }
+        DeadlineProfile& merge(const DeadlineProfile& other) {
+            count += other.count;
+            misses += other.misses;
+            lateness += other.lateness;
+            max_lateness = std::max(max_lateness, other.max_lateness);
+            tardiness.merge(other.tardiness);
+            demand += other.demand;
+            first = std::min(first, other.first);
+            last = std::max(last, other.last);
+            max_density = std::max(max_density, other.max_density);
+            return *this;
+        }
+
+        double getMissRate() const {
+            return count == 0 ? 0 : misses / (double)(count);
+        }
+        double getAvgLateness() const {
+            return count == 0 ? 0 : lateness / count;
+        }
+        // CPU demand of the deadline processes per step of their span
+        double getDemand() const {
+            return last <= first ? 0 : demand / (double)(last - first);
+        }
+        // the density bound on the demand for cpus CPUs
+        double getBound(CPUID cpus) const {
+            return cpus - (cpus - 1.0) * std::min(1.0, max_density);
+        }
+        bool withinBound(CPUID cpus) const {
+            return getDemand() <= getBound(cpus);
+        }
+
+        void print(CPUID cpus, int indent = 0) const {
+            std::string ind(indent, ' ');
+            std::cout << std::setprecision(5);
+            std::cout << ind << "Misses:         " << misses << " of " << count << " (" << 100 * getMissRate() << "%)" << std::endl;
+            std::cout << ind << "Lateness:       " << getAvgLateness() << " avg, " << max_lateness << " max" << std::endl;
+            std::cout << ind << "Tardiness:      ";
+            for(int i = 0; i < 4; i++)
+                std::cout << (i == 0 ? "" : " / ") << tardiness.percentile(LatencyProfile::PERCENTILES[i]);
+            std::cout << " (p50 / p90 / p99 / p99.9)" << std::endl;
+            std::cout << ind << "Demand per CPU: " << 100 * getDemand() / cpus << "% (bound " << 100 * getBound(cpus) / cpus << "%" << (withinBound(cpus) ? "" : ", exceeded") << ")" << std::endl;
+        }
+    };
+
+    // every aggregate SimulationStats reports, computed in one pass over its processes
+    struct SimulationMetrics {
+        StepSum turnaround = 0;
+        StepSum wait = 0;
+        StepSum response = 0;
+        StepSum io_wait = 0;
+        StepSum io_service = 0;
+        StepSum process_length = 0;
+        double response_adjusted = 0;
+        StepSum process_states[PROCESS_STATE_COUNT] = {};
+        unsigned process_seen = 0;
+        LatencyProfile latency;
+        ShareProfile share;
+        DeadlineProfile deadlines;
+        History<CPUState> cpus;             // collapsed over every CPU
+        History<ProcessState> processes;    // collapsed over every process
+
+        void add(const ProcessStats& p) {
+            ProcessSummary sum = p.summarize();
+            turnaround += sum.turnaround;
+            wait += sum.wait;
+            response += sum.response;
+            io_wait += sum.io_wait;
+            io_service += sum.io_service;
+            process_length += sum.length;
+            response_adjusted += sum.response_adjusted;
+            for(std::size_t i = 0; i < PROCESS_STATE_COUNT; i++)
+                process_states[i] += sum.states[i];
+            process_seen |= sum.seen;
+            latency.record(p.prio, sum);
+            share.record(p.prio, p.tickets, sum);
+            deadlines.record(p, sum);
+        }
+
+        SimulationMetrics& merge(const SimulationMetrics& other) {
+            turnaround += other.turnaround;
+            wait += other.wait;
+            response += other.response;
+            io_wait += other.io_wait;
+            io_service += other.io_service;
+            process_length += other.process_length;
+            response_adjusted += other.response_adjusted;
+            for(std::size_t i = 0; i < PROCESS_STATE_COUNT; i++)
+                process_states[i] += other.process_states[i];
+            process_seen |= other.process_seen;
+            latency.merge(other.latency);
+            share.merge(other.share);
+            deadlines.merge(other.deadlines);
+            return *this;
         }
     };
 
     // all stats for a single simulation
     struct SimulationStats {
+        // processes are summarised in chunks of this many, by worker threads once there is more than one chunk
+        //      the chunks are merged in order, so the result does not depend on the number of threads
+        static constexpr std::size_t METRICS_CHUNK = 4096;
+
         SystemSettings settings;
         std::vector<ProcessStats> ps;
         std::vector<CPUStats> cs;
+        mutable std::optional<SimulationMetrics> metrics;      // see getMetrics()
+        MemoryFootprint memory;     // filled by a System run with MEMORY_ACCOUNTING
+        std::vector<GroupStats> gs; // filled by a System run under Scheduler::fair with settings.GROUPS
+
+        SimulationMetrics computeMetrics() const {
+            std::size_t chunks = (ps.size() + METRICS_CHUNK - 1) / METRICS_CHUNK;
+            std::vector<SimulationMetrics> parts(std::max<std::size_t>(chunks, 1));
+            auto summarize = [this, &parts](std::size_t c) {
+                auto end = std::min(ps.size(), (c + 1) * METRICS_CHUNK);
+                for(auto i = c * METRICS_CHUNK; i < end; i++)
+                    parts[c].add(ps[i]);
+            };
+            std::size_t workers = std::min<std::size_t>(chunks, std::thread::hardware_concurrency());
+            if(workers > 1) {
+                std::atomic<std::size_t> next(0);
+                std::vector<std::thread> pool;
+                for(std::size_t w = 0; w < workers; w++)
+                    pool.emplace_back([&next, &summarize, chunks]() {
+                        for(std::size_t c; (c = next++) < chunks; )
+                            summarize(c);
+                    });
+                for(auto& t : pool)
+                    t.join();
+            } else {
+                for(std::size_t c = 0; c < chunks; c++)
+                    summarize(c);
+            }
+
+            SimulationMetrics out = std::move(parts.front());
+            for(std::size_t c = 1; c < parts.size(); c++)
+                out.merge(parts[c]);
+            // same ordering as collapseSums
+            for(std::size_t i = 0; i < PROCESS_STATE_COUNT; i++)
+                if(out.process_seen & (1u << i))
+                    out.processes.pushSum((ProcessState)(i), out.process_states[i]);
+            std::list<History<CPUState>> hists;
+            std::for_each(cs.begin(), cs.end(), [&hists](const CPUStats& c){ hists.push_back(c.hist); });
+            out.cpus = collapseSums(hists.begin(), hists.end(), CPUState::idle);
+            return out;
+        }
 
         template<class PSIt, class CSIt>
         SimulationStats(SystemSettings sett, PSIt p_start, PSIt p_end, CSIt c_start, CSIt c_end) : settings(sett), ps(p_start, p_end), cs(c_start, c_end) {}
 
+        // computed on first use and cached
+        const SimulationMetrics& getMetrics() const {
+            if(!metrics)
+                metrics = computeMetrics();
+            return *metrics;
+        }
+        // must be called after modifying ps or cs
+        void invalidateMetrics() {
+            metrics.reset();
+        }
+
         // units: Proc / Step
         double getThroughput() const {
-            /**/Step total_steps = cs.front().hist.duration();
-            return settings.PROCESS_COUNT / (double)(total_steps);
+            StepSum total_steps = cs.front().hist.duration();
+            return ps.size() / (double)(total_steps);
         }
         double getAvgTurnaround() const {
-            /**/Step sum = 0;
-            for(auto& p : ps)
-                sum += p.getTurnaround();
-            
-            return sum / (double)(ps.size());
+            return getMetrics().turnaround / (double)(ps.size());
         }
         double getAvgWait() const {
-            /**/Step sum = 0;
-            for(auto& p : ps)
-                sum += p.getWait();
-            
-            return sum / (double)(ps.size());
+            return getMetrics().wait / (double)(ps.size());
         }
         double getAvgResponse() const {
-            /**/Step sum = 0;
-            for(auto& p : ps)
-                sum += p.getResponse();
-            
-            return sum / (double)(ps.size());
+            return getMetrics().response / (double)(ps.size());
+        }
+        double getAvgIOWait() const {
+            return getMetrics().io_wait / (double)(ps.size());
+        }
+        double getAvgIOService() const {
+            return getMetrics().io_service / (double)(ps.size());
         }
         double getAvgResponseAdjusted() const {
-            double sum = 0;
+            return getMetrics().response_adjusted / (double)(ps.size());
+        }
+        // fraction of switches in which found the process cache-warm / had to migrate it
+        double getWarmSwitchRate() const {
+            StepSum warm = 0, total = 0;
+            for(auto& c : cs) {
+                warm += c.warm_switches;
+                total += c.switches_in;
+            }
+            return total == 0 ? 0 : warm / (double)(total);
+        }
+        double getMigrationRate() const {
+            StepSum migr = 0, total = 0;
+            for(auto& c : cs) {
+                migr += c.migrations;
+                total += c.switches_in;
+            }
+            return total == 0 ? 0 : migr / (double)(total);
+        }
+        // joules over every CPU, including idle time
+        double getEnergy() const {
+            double total = 0;
+            for(auto& c : cs)
+                total += c.energy;
+            return total;
+        }
+        double getEnergyPerProcess() const {
+            return getEnergy() / ps.size();
+        }
+        // units: Proc / J
+        double getThroughputPerJoule() const {
+            double e = getEnergy();
+            return e == 0 ? 0 : ps.size() / e;
+        }
+        // of the energy, the part charged to processes (the rest was spent idle)
+        double getAttributedEnergy() const {
+            double total = 0;
             for(auto& p : ps)
-                sum += p.getResponseAdjusted();
-            
-            return sum / (double)(ps.size());
+                total += p.energy;
+            return total;
+        }
+
+        // most bytes the System held at once (0 without MEMORY_ACCOUNTING)
+        uint64_t getPeakBytes() const {
+            return memory.total.peak;
+        }
+        uint64_t getAllocations() const {
+            return memory.total.allocations;
+        }
+        // approximate bytes held by ps and cs (the cached metrics excluded)
+        uint64_t approxBytes() const {
+            uint64_t out = sizeof(SimulationStats) + ps.capacity() * sizeof(ProcessStats) + cs.capacity() * sizeof(CPUStats) + gs.capacity() * sizeof(GroupStats);
+            for(auto& p : ps)
+                out += p.hist.heapBytes();
+            for(auto& c : cs)
+                out += c.hist.heapBytes();
+            return out;
+        }
+
+        StepSum getThrottles() const {
+            StepSum total = 0;
+            for(auto& g : gs)
+                total += g.throttles;
+            return total;
+        }
+        // of each group: its weight over its siblings', times its parent's target (parents come before their subgroups)
+        std::vector<double> getGroupTargets() const {
+            const std::vector<GroupSettings>& groups = settings.GROUPS;
+            std::vector<double> weights(groups.size() + 1, 0), out(groups.size());
+            auto slot = [&groups](std::size_t parent) { return parent == GroupSettings::ROOT ? groups.size() : parent; };
+            for(auto& g : groups)
+                weights[slot(g.parent)] += g.weight;
+            for(std::size_t i = 0; i < groups.size(); i++)
+                out[i] = groups[i].weight / weights[slot(groups[i].parent)] * (groups[i].parent == GroupSettings::ROOT ? 1 : out[groups[i].parent]);
+            return out;
+        }
+        // of each group: its fraction of the CPU steps run by every group
+        std::vector<double> getGroupShares() const {
+            StepSum total = 0;
+            for(auto& g : gs)
+                if(settings.GROUPS.at(g.id).parent == GroupSettings::ROOT)
+                    total += g.ran;
+            std::vector<double> out;
+            for(auto& g : gs)
+                out.push_back(total == 0 ? 0 : g.ran / (double)(total));
+            return out;
+        }
+
+        StepSum getPreemptions() const {
+            StepSum total = 0;
+            for(auto& c : cs)
+                total += c.preemptions;
+            return total;
         }
         // divide by number of CPUs
         double adjustForCPUs(double n) const {
@@ -279,23 +1036,38 @@ namespace Simulation {
         }
         // multiply by average process length
         double getAvgProcessLength() const {
-            /**/Step total_process_length = 0;
-            for(auto& p : ps)
-                for(auto it = p.plan.cbegin(); it != p.plan.cend(); it++)
-                    total_process_length += *it;
-            
-            return total_process_length / (double)(settings.PROCESS_COUNT);
+            return getMetrics().process_length / (double)(ps.size());
         }
 
-        History<CPUState> collapseCPUHistory() const {
-            std::list<History<CPUState>> hists;
-            std::for_each(cs.begin(), cs.end(), [&hists](const CPUStats& c){ hists.push_back(c.hist); });
-            return collapseSums(hists.begin(), hists.end(), CPUState::idle);
+        const LatencyProfile& getLatencyProfile() const {
+            return getMetrics().latency;
         }
-        History<ProcessState> collapseProcessHistory() const {
-            std::list<History<ProcessState>> hists;
-            std::for_each(ps.begin(), ps.end(), [&hists](const ProcessStats& p){ hists.push_back(p.hist); });
-            return collapseSums(hists.begin(), hists.end(), ProcessState::exit);
+
+        const ShareProfile& getShareProfile() const {
+            return getMetrics().share;
+        }
+        // one process's fraction of all tickets / of the summed service rates
+        double getTargetShare(const ProcessStats& p) const {
+            return getShareProfile().target(p.tickets);
+        }
+        double getAchievedShare(const ProcessStats& p) const {
+            return getShareProfile().achieved(ShareProfile::serviceRate(p.summarize()));
+        }
+
+        const DeadlineProfile& getDeadlineProfile() const {
+            return getMetrics().deadlines;
+        }
+        // fraction of one CPU's steps spent processing
+        double getCPUUtilization(CPUID i) const {
+            StepSum total = cs.at(i).hist.duration();
+            return total == 0 ? 0 : cs.at(i).hist.duration(CPUState::processing) / (double)(total);
+        }
+
+        const History<CPUState>& collapseCPUHistory() const {
+            return getMetrics().cpus;
+        }
+        const History<ProcessState>& collapseProcessHistory() const {
+            return getMetrics().processes;
         }
         void printCPUStatsSummary() const {
             std::cout << std::endl << "CPU Stats: " << std::endl;
@@ -330,11 +1102,53 @@ namespace Simulation {
             std::cout << "        Raw:            " << stat << " Steps" << std::endl;
             stat = getAvgResponseAdjusted();
             std::cout << "        Adjusted:       " << stat << "x longer" << std::endl;
+            std::cout << "    Switches In: " << std::endl;
+            std::cout << "        Warm:           " << 100 * getWarmSwitchRate() << "%" << std::endl;
+            std::cout << "        Migrations:     " << 100 * getMigrationRate() << "%" << std::endl;
+            std::cout << "        Preemptions:    " << getPreemptions() << std::endl;
+            std::cout << "    Avg IO: " << std::endl;
+            std::cout << "        Wait:           " << getAvgIOWait() << " Steps" << std::endl;
+            std::cout << "        Service:        " << getAvgIOService() << " Steps" << std::endl;
+            std::cout << "    Latency Percentiles: " << std::endl;
+            getLatencyProfile().print(8);
+            if(settings.SCHEDULER != Scheduler::priority) {
+                std::cout << "    CPU Share: " << std::endl;
+                getShareProfile().print(8);
+            }
+            if(!gs.empty()) {
+                std::cout << "    Group Target / Achieved Share: " << std::endl;
+                std::vector<double> target = getGroupTargets(), achieved = getGroupShares();
+                for(auto& g : gs) {
+                    std::cout << "        " << g.id << ": " << 100 * target[g.id] << "% / " << 100 * achieved[g.id] << "%";
+                    if(g.throttles > 0)
+                        std::cout << " (throttled " << g.throttles << " times, " << g.throttled << " Steps)";
+                    std::cout << std::endl;
+                }
+            }
+            if(getDeadlineProfile().count > 0) {
+                std::cout << "    Deadlines: " << std::endl;
+                getDeadlineProfile().print(cs.size(), 8);
+                std::cout << "        CPU Utilization:";
+                for(CPUID i = 0; i < cs.size(); i++)
+                    std::cout << " " << 100 * getCPUUtilization(i) << "%";
+                std::cout << std::endl;
+            }
             std::cout << "    Throughput: " << std::endl;
             stat = getThroughput();
             std::cout << "        Raw:            "<< stat << " Proc per Step           (" << 1/stat << " Steps per Proc)" << std::endl;
             stat = adjustForCPUs(stat);
             std::cout << "        CPU Adjusted:   " << stat << " Proc per Step per CPU  (" << 1/stat << " Step per Proc per CPU)" << std::endl;
+            std::cout << "        Per Joule:      " << getThroughputPerJoule() << " Proc per J" << std::endl;
+            std::cout << "    Energy: " << std::endl;
+            std::cout << "        Total:          " << getEnergy() << " J (" << 100 * getAttributedEnergy() / getEnergy() << "% while holding a process)" << std::endl;
+            std::cout << "        Per Process:    " << getEnergyPerProcess() << " J" << std::endl;
+            if(memory.accounted) {
+                std::cout << "    Memory: " << std::endl;
+                std::cout << "        Peak:           " << getPeakBytes() << " bytes (" << getAllocations() << " allocations)" << std::endl;
+                for(std::size_t i = 0; i < MEMORY_PART_COUNT; i++)
+                    std::cout << "        " << std::left << std::setw(16) << to_string((MemoryPart)(i)) + ":" << std::right << memory.parts[i].peak << " bytes peak" << std::endl;
+                std::cout << "        Stats:          " << memory.stats_bytes << " bytes" << std::endl;
+            }
 
             std::cout << std::endl;
             printCPUStatsSummary();
@@ -428,6 +1242,42 @@ namespace Simulation {
                     throw "Error opening file " + path;
                 proc_avg_pi << collapseProcessHistory().to_piechart_csv();
             }
+
+            // latency percentiles, overall and per priority
+            path = folder + "/latency.csv";
+            std::ofstream lat(path, std::ofstream::out);
+            if(!lat.is_open())
+                throw "Error opening file " + path;
+            lat << getLatencyProfile().to_csv();
+
+            // target and achieved CPU share, per priority and per process
+            path = folder + "/share.csv";
+            std::ofstream share(path, std::ofstream::out);
+            if(!share.is_open())
+                throw "Error opening file " + path;
+            share << getShareProfile().to_csv();
+            path = folder + "/process_share.csv";
+            std::ofstream pshare(path, std::ofstream::out);
+            if(!pshare.is_open())
+                throw "Error opening file " + path;
+            pshare << std::setprecision(5) << "PID,Priority,Tickets,Target Share,Achieved Share" << std::endl;
+            for(auto& p : ps)
+                pshare << p.id << "," << (int)(p.prio) << "," << p.tickets << "," << getTargetShare(p) << "," << getAchievedShare(p) << std::endl;
+
+            // target and achieved CPU share and throttling, per group
+            if(!gs.empty()) {
+                path = folder + "/groups.csv";
+                std::ofstream groups(path, std::ofstream::out);
+                if(!groups.is_open())
+                    throw "Error opening file " + path;
+                std::vector<double> target = getGroupTargets(), achieved = getGroupShares();
+                groups << std::setprecision(5) << "Group,Parent,Weight,Quota,Period,Ran,Target Share,Achieved Share,Throttles,Throttled Steps" << std::endl;
+                for(auto& g : gs) {
+                    const GroupSettings& gr = settings.GROUPS.at(g.id);
+                    groups << g.id << "," << (gr.parent == GroupSettings::ROOT ? std::string("root") : std::to_string(gr.parent)) << "," << gr.weight << "," << gr.quota << "," << gr.period << ","
+                        << g.ran << "," << target[g.id] << "," << achieved[g.id] << "," << g.throttles << "," << g.throttled << std::endl;
+                }
+            }
         }
 
         void exportStats() const {
@@ -435,7 +1285,7 @@ namespace Simulation {
         }
 
         static std::string to_csv_header() {
-            return "Settings,Process Length,Turnaround,Wait,Response,Response Adjusted,Throughput,Throughput INV,Throughput CPU,CPU Processing%";
+            return "Settings,Process Length,Turnaround,Wait,Response,Response Adjusted,Throughput,Throughput INV,Throughput CPU,CPU Processing%,IO Wait,IO Service,Warm Switch%,Migration%," + LatencyProfile::to_csv_header() + ",Preemptions,Max Ready Wait,Share Error,Deadline Miss%,Avg Lateness,Tardiness p99,Energy,Energy per Process,Throughput per J,Peak Bytes,Allocations,Stats Bytes,Throttles";
         }
 
         // Settings,Turnaround,Wait,Response,Throughput,Throughput INV,Throughput CPU,CPU Avg,CPU Max,CPU Min
@@ -451,7 +1301,191 @@ namespace Simulation {
                 << getThroughput() << ","
                 << 1/getThroughput() << ","
                 << adjustForCPUs(1/getThroughput()) << ","
-                << 100 * collapseCPUHistory().duration(CPUState::processing) / (double)(collapseCPUHistory().duration());
+                << 100 * collapseCPUHistory().duration(CPUState::processing) / (double)(collapseCPUHistory().duration()) << ","
+                << getAvgIOWait() << ","
+                << getAvgIOService() << ","
+                << 100 * getWarmSwitchRate() << ","
+                << 100 * getMigrationRate() << ","
+                << LatencyProfile::to_csv_row(getLatencyProfile().all) << ","
+                << getPreemptions() << ","
+                << getLatencyProfile().all.max_ready_wait << ","
+                << getShareProfile().error() << ","
+                << 100 * getDeadlineProfile().getMissRate() << ","
+                << getDeadlineProfile().getAvgLateness() << ","
+                << getDeadlineProfile().tardiness.percentile(99) << ","
+                << getEnergy() << ","
+                << getEnergyPerProcess() << ","
+                << getThroughputPerJoule() << ","
+                << getPeakBytes() << ","
+                << getAllocations() << ","
+                << memory.stats_bytes << ","
+                << getThrottles();
+
+            return out.str();
+        }
+    };
+
+    // stats for an open-system (steady-state) simulation
+    // retired processes are folded into batch means instead of being kept, so memory stays bounded however long the horizon
+    //      batches hold batch_size completions each, when MAX_BATCHES are full adjacent pairs merge and batch_size doubles
+    //      the warm-up is the MSER truncation point over the turnaround batch means, and is excluded from every average
+    struct SteadyStateStats {
+        struct Batch {
+            StepSum turnaround;
+            StepSum wait;
+            StepSum response;
+            StepSum count;
+            Step closed;                // step on which the batch's last completion retired
+            StepSum cpu_processing;     // cumulative processing steps over all CPUs when the batch closed
+
+            Batch& operator+=(const Batch& b) {
+                turnaround += b.turnaround;
+                wait += b.wait;
+                response += b.response;
+                count += b.count;
+                closed = b.closed;
+                cpu_processing = b.cpu_processing;
+                return *this;
+            }
+        };
+
+        static constexpr std::vector<Batch>::size_type MAX_BATCHES = 512;
+        // MSER-5
+        static constexpr StepSum INITIAL_BATCH_SIZE = 5;
+
+        SystemSettings settings;
+        Step horizon = 0;
+        StepSum arrived = 0;
+        StepSum live = 0;               // still in the system at the horizon
+        StepSum batch_size = INITIAL_BATCH_SIZE;
+        std::vector<Batch> batches;
+        Batch open = {0, 0, 0, 0, 0, 0};
+        std::vector<Batch>::size_type warmup = 0;   // number of batches truncated
+
+        StepSum retired() const {
+            StepSum total = open.count;
+            for(auto& b : batches)
+                total += b.count;
+            return total;
+        }
+
+        // fold one retired process into the open batch
+        // returns true if that closed the batch, in which case closeBatch() must be called
+        bool record(Step turnaround, Step wait, Step response, Step s) {
+            open.turnaround += turnaround;
+            open.wait += wait;
+            open.response += response;
+            open.closed = s;
+            return ++open.count == batch_size;
+        }
+
+        void closeBatch(StepSum cpu_processing) {
+            open.cpu_processing = cpu_processing;
+            batches.push_back(open);
+            open = {0, 0, 0, 0, 0, 0};
+            if(batches.size() == MAX_BATCHES) {
+                // merge adjacent pairs to keep memory bounded
+                for(std::vector<Batch>::size_type i = 0; i < batches.size() / 2; i++) {
+                    batches[i] = batches[2*i];
+                    batches[i] += batches[2*i + 1];
+                }
+                batches.resize(batches.size() / 2);
+                batch_size *= 2;
+            }
+        }
+
+        // MSER: the truncation d minimising the standard error of the remaining batch means
+        //      sum_{i>d} (X_i - mean_d)^2 / (n-d)^2, for d up to n/2
+        void finish(Step h, StepSum a, StepSum l) {
+            horizon = h;
+            arrived = a;
+            live = l;
+            warmup = 0;
+            auto n = batches.size();
+            if(n < 2)
+                return;
+            // suffix sums of the means and squared means
+            std::vector<double> sum(n + 1, 0), sq(n + 1, 0);
+            for(auto i = n; i-- > 0; ) {
+                double x = batches[i].turnaround / (double)(batches[i].count);
+                sum[i] = sum[i+1] + x;
+                sq[i] = sq[i+1] + x*x;
+            }
+            double best = std::numeric_limits<double>::infinity();
+            for(std::vector<Batch>::size_type d = 0; d <= n / 2; d++) {
+                double k = n - d;
+                double mser = (sq[d] - sum[d]*sum[d]/k) / (k*k);
+                if(mser < best) {
+                    best = mser;
+                    warmup = d;
+                }
+            }
+        }
+
+        Step getWarmupEnd() const {
+            return warmup == 0 ? 0 : batches[warmup-1].closed;
+        }
+        // completions after the warm-up
+        Batch getSteadyState() const {
+            Batch total = {0, 0, 0, 0, 0, 0};
+            for(auto i = warmup; i < batches.size(); i++)
+                total += batches[i];
+            return total;
+        }
+
+        double getAvgTurnaround() const {
+            Batch b = getSteadyState();
+            return b.count == 0 ? 0 : b.turnaround / (double)(b.count);
+        }
+        double getAvgWait() const {
+            Batch b = getSteadyState();
+            return b.count == 0 ? 0 : b.wait / (double)(b.count);
+        }
+        double getAvgResponse() const {
+            Batch b = getSteadyState();
+            return b.count == 0 ? 0 : b.response / (double)(b.count);
+        }
+        // units: Proc / Step, over the post-warm-up window of completed batches
+        double getThroughput() const {
+            Batch b = getSteadyState();
+            return b.count == 0 ? 0 : b.count / (double)(b.closed - getWarmupEnd());
+        }
+        double getCPUUtilization() const {
+            Batch b = getSteadyState();
+            if(b.count == 0)
+                return 0;
+            StepSum before = warmup == 0 ? 0 : batches[warmup-1].cpu_processing;
+            return (b.cpu_processing - before) / ((double)(b.closed - getWarmupEnd()) * settings.CPU_COUNT);
+        }
+
+        void printStats() const {
+            settings.print();
+
+            std::cout << std::setprecision(5) << std::endl << "Steady State Stats: " << std::endl;
+            std::cout << "    Horizon:            " << horizon << " Steps" << std::endl;
+            std::cout << "    Arrived:            " << arrived << " (" << live << " still live)" << std::endl;
+            std::cout << "    Warm-up:            " << warmup << " of " << batches.size() << " batches (until Step " << getWarmupEnd() << ")" << std::endl;
+            std::cout << "    Avg Turnaround:     " << getAvgTurnaround() << " Steps" << std::endl;
+            std::cout << "    Avg Wait:           " << getAvgWait() << " Steps" << std::endl;
+            std::cout << "    Avg Response:       " << getAvgResponse() << " Steps" << std::endl;
+            std::cout << "    Throughput:         " << getThroughput() << " Proc per Step" << std::endl;
+            std::cout << "    CPU Processing:     " << 100 * getCPUUtilization() << "%" << std::endl;
+            std::cout << std::endl;
+        }
+
+        static std::string to_csv_header() {
+            return "Settings,Horizon,Arrived,Retired,Warmup End,Turnaround,Wait,Response,Throughput,CPU Processing%";
+        }
+
+        std::string to_csv_row() const {
+            std::ostringstream out;
+
+            out << to_string(settings) << "," << horizon << "," << arrived << "," << retired() << "," << getWarmupEnd() << "," << std::setprecision(5)
+                << getAvgTurnaround() << ","
+                << getAvgWait() << ","
+                << getAvgResponse() << ","
+                << getThroughput() << ","
+                << 100 * getCPUUtilization();
 
             return out.str();
         }
@@ -479,7 +1513,20 @@ namespace Simulation {
                 throw "Error opening file" + folder + "/" + "summary.csv";
             summ << SimulationStats::to_csv_header() << std::endl;
             for(auto& run : runs)
-                summ << run.to_csv_row() << std::endl;            
+                summ << run.to_csv_row() << std::endl;
+
+            // latency distributions pooled over every run
+            std::ofstream lat(folder + "/" + "latency.csv", std::ofstream::out);
+            if(!lat.is_open())
+                throw "Error opening file" + folder + "/" + "latency.csv";
+            lat << getLatencyProfile().to_csv();
+        }
+
+        LatencyProfile getLatencyProfile() const {
+            LatencyProfile out;
+            for(auto& run : runs)
+                out.merge(run.getLatencyProfile());
+            return out;
         }
     };
 }
@@ -0,0 +1,293 @@
+// defines a sweep: a grid of settings crossed with workload seeds, which can be split into shards and merged
+
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include "typedefs.h"
+#include "system.h"
+#include "stats.h"
+#include "results_store.h"
+#include <vector>
+#include <map>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <algorithm>
+#include <cstdlib>
+#include <cerrno>
+#include <limits>
+#include <stdint.h>
+
+namespace Simulation {
+    // a sweep specification, read from a file of key = value lines ('#' starts a comment)
+    //      name = rr_sweep
+    //      cpu_count = 1,2,4,8             (or cpu_range = 1,10 for the logarithmic cpuRange)
+    //      process_count = 50
+    //      rr_time = 0,10,100
+    //      switching_in_delay = 7          (also switching_out_delay, switching_in_warm_delay, switching_in_migration_delay)
+    //      affinity_dispatch = 0,1         (also preemptive)
+    //      aging_interval = 0,1000
+    //      scheduler = priority,lottery,stride,edf,fair
+    //      governor = none,ondemand        (also governor_interval)
+    //      memory_accounting = 1
+    //      seeds = 1,2,3                   (or seed = 1 with replications = 3 for seeds 1,2,3)
+    // every listed value is crossed with every other, and every grid point is run with the workload of every seed
+    struct SweepSpec {
+        struct Job {
+            std::size_t index;
+            SystemSettings settings;
+            uint64_t seed;
+        };
+
+        std::string name = "sweep";
+        std::vector<SystemSettings> grid;
+        std::vector<uint64_t> seeds;
+
+        // a list of numbers, each at most max (the largest value of the field it sets, so none is silently truncated)
+        static std::vector<uint64_t> parseList(std::string key, std::string value, uint64_t max = std::numeric_limits<uint64_t>::max()) {
+            std::vector<uint64_t> out;
+            std::istringstream in(value);
+            std::string item;
+            while(std::getline(in, item, ',')) {
+                char* end;
+                errno = 0;
+                out.push_back(std::strtoull(item.c_str(), &end, 10));
+                if(item.find_first_not_of(" \t") == std::string::npos || std::string(end).find_first_not_of(" \t") != std::string::npos || item.find('-') != std::string::npos)
+                    throw "Bad value for " + key + ": " + value;
+                if(errno == ERANGE || out.back() > max)
+                    throw "Value out of range for " + key + ": " + item + " (at most " + std::to_string(max) + ")";
+            }
+            if(out.empty())
+                throw "No values for " + key;
+            return out;
+        }
+
+        // a list of enum values by name (last is the final enumerator), as their indices
+        template<class E>
+        static std::vector<uint64_t> parseNames(std::string key, std::string value, E last) {
+            std::vector<uint64_t> out;
+            std::istringstream in(value);
+            std::string item;
+            while(std::getline(in, item, ',')) {
+                item.erase(0, item.find_first_not_of(" \t"));
+                item.erase(item.find_last_not_of(" \t") + 1);
+                uint64_t k = 0;
+                while(k <= (uint64_t)(last) && to_string((E)(k)) != item)
+                    k++;
+                if(k > (uint64_t)(last))
+                    throw "Bad value for " + key + ": " + value;
+                out.push_back(k);
+            }
+            if(out.empty())
+                throw "No values for " + key;
+            return out;
+        }
+
+        // crosses every setting in grid with every value of one field
+        template<class Set>
+        static std::vector<SystemSettings> cross(const std::vector<SystemSettings>& grid, const std::vector<uint64_t>& vals, Set set) {
+            std::vector<SystemSettings> out;
+            for(auto& sett : grid)
+                for(auto v : vals) {
+                    SystemSettings s = sett;
+                    set(s, v);
+                    out.push_back(s);
+                }
+            return out;
+        }
+
+        static SweepSpec fromFile(std::string path) {
+            std::ifstream f(path);
+            if(!f.is_open())
+                throw "Error opening file " + path;
+            std::map<std::string, std::string> kv;
+            std::string line;
+            while(std::getline(f, line)) {
+                line = line.substr(0, line.find('#'));
+                auto eq = line.find('=');
+                if(eq == std::string::npos) {
+                    if(line.find_first_not_of(" \t\r") != std::string::npos)
+                        throw "Bad line in " + path + ": " + line;
+                    continue;
+                }
+                auto trim = [](std::string s) {
+                    auto b = s.find_first_not_of(" \t\r");
+                    return b == std::string::npos ? std::string() : s.substr(b, s.find_last_not_of(" \t\r") - b + 1);
+                };
+                kv[trim(line.substr(0, eq))] = trim(line.substr(eq + 1));
+            }
+            return fromMap(kv);
+        }
+
+        static SweepSpec fromMap(std::map<std::string, std::string> kv) {
+            SweepSpec spec;
+            auto take = [&kv](std::string key) {
+                auto it = kv.find(key);
+                if(it == kv.end())
+                    return std::string();
+                std::string v = (*it).second;
+                kv.erase(it);
+                return v;
+            };
+            std::string v;
+            if((v = take("name")) != "")
+                spec.name = v;
+
+            std::vector<SystemSettings> grid = {SystemSettings()};
+            if((v = take("cpu_range")) != "") {
+                auto r = parseList("cpu_range", v, std::numeric_limits<CPUID>::max());
+                if(r.size() != 2)
+                    throw "cpu_range takes min,max";
+                SystemSettings base;
+                std::vector<uint64_t> counts;
+                for(auto& s : cpuRange(base, r[1], r[0]))
+                    counts.push_back(s.CPU_COUNT);
+                grid = cross(grid, counts, [](SystemSettings& s, uint64_t x) { s.CPU_COUNT = x; });
+            }
+            if((v = take("cpu_count")) != "")
+                grid = cross(grid, parseList("cpu_count", v, std::numeric_limits<CPUID>::max()), [](SystemSettings& s, uint64_t x) { s.CPU_COUNT = x; });
+            if((v = take("process_count")) != "")
+                grid = cross(grid, parseList("process_count", v, std::numeric_limits<PID>::max()), [](SystemSettings& s, uint64_t x) { s.PROCESS_COUNT = x; });
+            if((v = take("rr_time")) != "")
+                grid = cross(grid, parseList("rr_time", v, std::numeric_limits<Step>::max()), [](SystemSettings& s, uint64_t x) { s.RR_TIME = x; });
+            // warm and migration costs follow the plain switching in cost unless given
+            if((v = take("switching_in_delay")) != "")
+                grid = cross(grid, parseList("switching_in_delay", v, std::numeric_limits<Step>::max()), [](SystemSettings& s, uint64_t x) {
+                    s.SWITCHING_IN_DELAY = s.SWITCHING_IN_WARM_DELAY = s.SWITCHING_IN_MIGRATION_DELAY = x;
+                });
+            if((v = take("switching_out_delay")) != "")
+                grid = cross(grid, parseList("switching_out_delay", v, std::numeric_limits<Step>::max()), [](SystemSettings& s, uint64_t x) { s.SWITCHING_OUT_DELAY = x; });
+            if((v = take("switching_in_warm_delay")) != "")
+                grid = cross(grid, parseList("switching_in_warm_delay", v, std::numeric_limits<Step>::max()), [](SystemSettings& s, uint64_t x) { s.SWITCHING_IN_WARM_DELAY = x; });
+            if((v = take("switching_in_migration_delay")) != "")
+                grid = cross(grid, parseList("switching_in_migration_delay", v, std::numeric_limits<Step>::max()), [](SystemSettings& s, uint64_t x) { s.SWITCHING_IN_MIGRATION_DELAY = x; });
+            if((v = take("affinity_dispatch")) != "")
+                grid = cross(grid, parseList("affinity_dispatch", v, 1), [](SystemSettings& s, uint64_t x) { s.AFFINITY_DISPATCH = x; });
+            if((v = take("preemptive")) != "")
+                grid = cross(grid, parseList("preemptive", v, 1), [](SystemSettings& s, uint64_t x) { s.PREEMPTIVE = x; });
+            if((v = take("aging_interval")) != "")
+                grid = cross(grid, parseList("aging_interval", v, std::numeric_limits<Step>::max()), [](SystemSettings& s, uint64_t x) { s.AGING_INTERVAL = x; });
+            if((v = take("scheduler")) != "")
+                grid = cross(grid, parseNames("scheduler", v, Scheduler::fair), [](SystemSettings& s, uint64_t x) { s.SCHEDULER = (Scheduler)(x); });
+            if((v = take("governor")) != "")
+                grid = cross(grid, parseNames("governor", v, Governor::ondemand), [](SystemSettings& s, uint64_t x) { s.GOVERNOR = (Governor)(x); });
+            if((v = take("governor_interval")) != "")
+                grid = cross(grid, parseList("governor_interval", v, std::numeric_limits<Step>::max()), [](SystemSettings& s, uint64_t x) { s.GOVERNOR_INTERVAL = x; });
+            if((v = take("memory_accounting")) != "")
+                grid = cross(grid, parseList("memory_accounting", v, 1), [](SystemSettings& s, uint64_t x) { s.MEMORY_ACCOUNTING = x; });
+            spec.grid = grid;
+
+            if((v = take("seeds")) != "") {
+                spec.seeds = parseList("seeds", v);
+            } else {
+                std::string seed = take("seed"), reps = take("replications");
+                uint64_t first = seed == "" ? 1 : parseList("seed", seed).front();
+                uint64_t count = reps == "" ? 1 : parseList("replications", reps).front();
+                for(uint64_t i = 0; i < count; i++)
+                    spec.seeds.push_back(first + i);
+            }
+            take("seed");
+            take("replications");
+
+            if(!kv.empty())
+                throw "Unknown sweep setting " + (*kv.begin()).first;
+            return spec;
+        }
+
+        std::size_t jobCount() const {
+            return grid.size() * seeds.size();
+        }
+
+        // job j belongs to shard (j % count)
+        // grid points are outermost, so a grid point's replications are spread across the shards
+        // a job's lottery draws come from its seed too (LOTTERY_SEED), as in compareSettings
+        std::vector<Job> jobs(std::size_t shard = 0, std::size_t count = 1) const {
+            std::vector<Job> out;
+            for(std::size_t j = shard; j < jobCount(); j += count) {
+                out.push_back({j, grid[j / seeds.size()], seeds[j % seeds.size()]});
+                out.back().settings.LOTTERY_SEED = out.back().seed;
+            }
+            return out;
+        }
+
+        std::string getFolderName() const {
+            return DATA_DIR + "/" + name;
+        }
+        std::string getShardPath(std::size_t shard, std::size_t count) const {
+            return getFolderName() + "/shard_" + std::to_string(shard) + "_of_" + std::to_string(count) + ".simr";
+        }
+    };
+
+    // runs the jobs of one shard, appending one chunk per job to the shard's results file
+    // a job's workload depends only on its seed and process count, so the results do not depend on how the sweep is sharded
+    void runShard(const SweepSpec& spec, std::size_t shard, std::size_t count) {
+        if(count == 0 || shard >= count)
+            throw "Bad shard " + std::to_string(shard) + "/" + std::to_string(count);
+        std::string cmd = "mkdir -p " + spec.getFolderName();
+        system(cmd.c_str());
+        std::string path = spec.getShardPath(shard, count);
+        // a rerun replaces the shard rather than appending to it
+        unlink(path.c_str());
+
+        std::map<std::pair<uint64_t, PID>, std::vector<ProcessPlan>> plan_map;
+        System sys(SystemSettings(), MemoryMode::arena);
+        for(auto& job : spec.jobs(shard, count)) {
+            auto key = std::make_pair(job.seed, job.settings.PROCESS_COUNT);
+            if(plan_map.find(key) == plan_map.end()) {
+                plan_map[key] = generateDataFiles(job.settings.PROCESS_COUNT, job.seed);
+            }
+            sys.updateSettings(job.settings);
+            sys.simulate(plan_map[key]);
+            SimulationStats stats = sys.outputStats();
+
+            std::vector<ResultsTable> tables = toResultsTables(stats, job.index);
+            tables.front().add("job", std::vector<uint64_t>{job.index});
+            tables.front().add("seed", std::vector<uint64_t>{job.seed});
+            tables.front().add("summary", std::vector<std::string>{stats.to_csv_row()});
+            appendResults(path, tables);
+        }
+    }
+
+    // joins the results files of count shards into results.simr and summary.csv, in job order
+    void mergeShards(const SweepSpec& spec, std::size_t count) {
+        std::vector<std::string> chunks(spec.jobCount());
+        std::vector<std::string> rows(spec.jobCount());
+        std::vector<bool> found(spec.jobCount(), false);
+        for(std::size_t shard = 0; shard < count; shard++) {
+            std::string path = spec.getShardPath(shard, count);
+            ResultsStore store(path);
+            std::vector<uint64_t> jobs = store.u64("runs", "job");
+            std::vector<std::string> summary = store.str("runs", "summary");
+            // one runs row per chunk
+            if(jobs.size() != store.chunkCount())
+                throw "Malformed shard " + path;
+            for(std::size_t i = 0; i < jobs.size(); i++) {
+                if(jobs[i] >= spec.jobCount())
+                    throw "Shard " + path + " does not match the sweep";
+                chunks[jobs[i]] = store.getChunk(i);
+                rows[jobs[i]] = summary[i];
+                found[jobs[i]] = true;
+            }
+        }
+        auto missing = std::find(found.begin(), found.end(), false);
+        if(missing != found.end())
+            throw "Job " + std::to_string(missing - found.begin()) + " is missing from the shards";
+
+        std::string path = spec.getFolderName() + "/results.simr";
+        unlink(path.c_str());
+        std::string all;
+        for(auto& c : chunks)
+            all += c;
+        appendChunk(path, all);
+
+        path = spec.getFolderName() + "/summary.csv";
+        std::ofstream summ(path, std::ofstream::out);
+        if(!summ.is_open())
+            throw "Error opening file " + path;
+        summ << SimulationStats::to_csv_header() << std::endl;
+        for(auto& r : rows)
+            summ << r << std::endl;
+    }
+}
+
+#endif
@@ -7,10 +7,19 @@
 #include "utility.h"
 #include "process.h"
 #include "stats.h"
+#include "memory.h"
+#include "workload.h"
+#include "io.h"
+#include "telemetry.h"
+#include "share.h"
+#include "realtime.h"
+#include "debug.h"
+#include <chrono>
 #include <cassert>
 #include <vector>
 #include <queue>
 #include <map>
+#include <set>
 #include <numeric>
 #include <algorithm>
 #include <limits>
@@ -19,30 +28,10 @@
 #include <cstdlib>
 #include <iomanip>
 #include <random>
+#include <array>
 
 
 namespace Simulation {
-    std::vector<ProcessPlan> generateDataFiles(PID n) {
-        std::vector<ProcessPlan> out;
-        for(PID i = 0; i < n; i++) {
-            // generate random bursts
-            std::list<Step> raw_bursts;
-            int burst_count = rand() % MAX_BURSTS + 1;
-            bool proc_orig = rand() % 2;
-            bool proc = proc_orig;
-            for(int b = 0; b < burst_count; b++)
-                raw_bursts.push_back( rand() % ((proc = !proc) ? MAX_IO_BURST : MAX_CPU_BURST) + 1);
-            // generate random prio
-            Priority p = rand() % MAX_PRIO;
-            ProcessInit init = {i, p, ProcessBursts(raw_bursts.begin(), raw_bursts.end(), proc_orig)};
-            // generate random arrival time
-            Step arr = rand() % (n*ARRIVAL_MAX_PER_PROCESS) + 1;
-            ProcessPlan pl = {arr, init};
-            out.push_back(pl);
-        }
-        return out;
-    }
-
     // a CPU stores
     //      a pointer to the current PCB
     //      a record of the most recent/current PID
@@ -60,9 +49,108 @@ namespace Simulation {
                                 // Timers: context_remove(switching_out), context_add(switching_in), round_robin(processing), 0(idle)
             CPUStats stats;
             SystemSettings settings;
+            StepSum processed;  // running count of processing steps, so it can be read without walking the History
+            unsigned credit;    // progress (in percent of a step) owed to the current process by the CPU's speed
+
+            // energy, see CPUPower
+            //  the joules of a busy, idle and sleeping step are worked out when the P-state changes rather than every step
+            CPUPower power;
+            std::size_t pstate;
+            double busy_joules;
+            double idle_joules;
+            double sleep_joules;
+            Step idle_run;      // consecutive idle steps, towards power.sleep_after
+            bool sleeping;
+            Step window_steps;  // governor: steps and processing steps since it last looked
+            Step window_busy;
+            Step idle_from;     // first idle Step not yet accounted (the System does not step idle CPUs, see idleUntil)
+
+            void setPState(std::size_t p) {
+                pstate = p;
+                stats.speed = settings.getCPUSpeed(stats.id) * power.pstates[p].speed / 100;
+                busy_joules = power.pstates[p].watts * STEP_SECONDS;
+            }
+
+            // every GOVERNOR_INTERVAL steps, moves the P-state by the utilization over the interval
+            void govern(bool busy) {
+                window_busy += busy;
+                if(++window_steps < settings.GOVERNOR_INTERVAL)
+                    return;
+                double util = window_busy / (double)(window_steps);
+                std::size_t top = power.pstates.size() - 1;
+                if(util >= settings.GOVERNOR_UP && pstate != top) {
+                    setPState(top);
+                    stats.frequency_changes++;
+                } else if(util < settings.GOVERNOR_DOWN && pstate > 0) {
+                    setPState(pstate - 1);
+                    stats.frequency_changes++;
+                }
+                window_steps = window_busy = 0;
+            }
+
+            // n idle steps of the governor, skipping ahead to each step on which it looks
+            void governIdle(Step n) {
+                while(n > 0) {
+                    Step quiet = std::min<Step>(n - 1, settings.GOVERNOR_INTERVAL > window_steps + 1 ? settings.GOVERNOR_INTERVAL - window_steps - 1 : 0);
+                    window_steps += quiet;
+                    n -= quiet + 1;
+                    govern(false);
+                }
+            }
+
+            // charges this step's energy to the CPU and to the process it holds
+            void spend(CPUState state) {
+                double j;
+                if(state == CPUState::idle || state == CPUState::assigned_idle) {
+                    j = sleeping ? sleep_joules : idle_joules;
+                    if(sleeping)
+                        stats.slept++;
+                    else if(state == CPUState::idle && power.sleep_after > 0 && ++idle_run >= power.sleep_after)
+                        sleeping = true;
+                } else {
+                    j = busy_joules;
+                }
+                stats.energy += j;
+                if(proc)
+                    proc->stats.energy += j;
+                if(settings.GOVERNOR != Governor::none)
+                    govern(state == CPUState::processing);
+            }
+
+            // steps of the current CPU burst completed this Step
+            Step work() {
+                credit += stats.speed;
+                Step w = credit / 100;
+                credit %= 100;
+                return w;
+            }
+
+            // cost of switching in p, which depends on where p last ran
+            Step switchInDelay(const PCB* p) {
+                stats.switches_in++;
+                if(p->last_cpu == std::numeric_limits<CPUID>::max())
+                    return settings.SWITCHING_IN_DELAY;
+                if(p->last_cpu != stats.id) {
+                    stats.migrations++;
+                    return std::max<Step>(1, settings.SWITCHING_IN_MIGRATION_DELAY);
+                }
+                // nothing else ran here since p did
+                if(last_id == p->id) {
+                    stats.warm_switches++;
+                    return std::max<Step>(1, settings.SWITCHING_IN_WARM_DELAY);
+                }
+                return settings.SWITCHING_IN_DELAY;
+            }
         public:
-            CPU(SystemSettings sett, CPUID id) : proc(nullptr), last_id(std::numeric_limits<PID>::max()), t(0, CPUState::idle), settings(sett) {
-                stats.id = id;
+            CPU(SystemSettings sett, CPUID id, std::pmr::memory_resource* mem = std::pmr::get_default_resource()) :
+                proc(nullptr), last_id(std::numeric_limits<PID>::max()), t(0, CPUState::idle), stats{id, History<CPUState>(mem)}, settings(sett), processed(0), credit(0),
+                power(sett.getCPUPower(id)), idle_run(0), sleeping(false), window_steps(0), window_busy(0), idle_from(0) {
+                if(power.pstates.empty())
+                    throw std::string("CPUPower needs at least one P-state");
+                idle_joules = power.idle_watts * STEP_SECONDS;
+                sleep_joules = power.sleep_watts * STEP_SECONDS;
+                // starts at the last (fastest) P-state, which runs at getCPUSpeed(id) when its speed is 100
+                setPState(power.pstates.size() - 1);
             }
 
             CPUStats getStats() const {
@@ -71,6 +159,17 @@ namespace Simulation {
             CPUState getState() const {
                 return t.getData();
             }
+            CPUID getID() const {
+                return stats.id;
+            }
+            StepSum processingSteps() const {
+                return processed;
+            }
+            // collapses the History into one period per state once it holds more than limit periods
+            void compactHistory(std::size_t limit) {
+                if(stats.hist.size() > limit)
+                    stats.hist = collapseSums(stats.hist);
+            }
             bool isFCFS() const {
                 return settings.RR_TIME == 0;
             }
@@ -83,11 +182,35 @@ namespace Simulation {
             PID getPID() const {
                 return last_id;
             }
+            // marks an idle CPU as idle from Step from on
+            void park(Step from) {
+                idle_from = from;
+            }
+            // accounts the idle Steps from the one given to park() up to (not including) end as step() would have
+            //      History, energy, sleep and governor, in one go rather than a Step at a time
+            void idleUntil(Step end) {
+                if(end <= idle_from)
+                    return;
+                Step n = end - idle_from;
+                idle_from = end;
+                stats.hist.push(CPUState::idle, n);
+                // awake until power.sleep_after idle steps in a row, asleep from then on
+                Step awake = n;
+                if(sleeping) {
+                    awake = 0;
+                } else if(power.sleep_after > 0) {
+                    awake = std::min<Step>(n, power.sleep_after - idle_run);
+                    idle_run += awake;
+                    sleeping = idle_run >= power.sleep_after;
+                }
+                stats.slept += n - awake;
+                stats.energy += awake * idle_joules + (n - awake) * sleep_joules;
+                if(settings.GOVERNOR != Governor::none)
+                    governIdle(n);
+            }
             // deassigns current process 
             // starts context_remove timer
             void deassign() {
-                //std::cout << "deassign() ";
-                //std::cout << to_string(proc->state) << std::endl;
                 // update process state baed off burst state
                 if(proc->bursts.empty()) {
                     proc->state = ProcessState::exit;
@@ -96,15 +219,28 @@ namespace Simulation {
                 }
                 t = Timer<CPUState>(settings.SWITCHING_OUT_DELAY, CPUState::switching_out);
             }
+            // deassigns the current process in favour of a higher-priority one
+            void preempt() {
+                stats.preemptions++;
+                proc->stats.preemptions++;
+                deassign();
+            }
             // assigns new process 
             // starts context_add timer
             void assign(PCB* p) {
-                //std::cout << "assign()" << std::endl;
-                //std::cout << to_string(proc->state) << std::endl;
+                Step delay = switchInDelay(p);
+                if(sleeping) {
+                    delay += power.wake_latency;
+                    stats.wakeups++;
+                    sleeping = false;
+                }
+                idle_run = 0;
                 proc = p;
                 last_id = proc->id;
+                proc->last_cpu = stats.id;
                 proc->state = ProcessState::switching;
-                t = Timer<CPUState>(settings.SWITCHING_IN_DELAY, CPUState::switching_in);
+                credit = 0;
+                t = Timer<CPUState>(delay, CPUState::switching_in);
             }
             // (if not idle) Increments current timer and advances the current process by one step
             // return value of true indicates old process should be returned to ready queue and new process should be assigned
@@ -113,11 +249,15 @@ namespace Simulation {
                 // get state
                 CPUState state = getState();
                 stats.hist.inc(state);
+                if(state == CPUState::processing)
+                    processed++;
+                spend(state);
                 if(!assigned()) {
                     return true;
                 } else {
                     // step process and CPU timer
-                    bool p_ret = proc->step();
+                    // only CPU bursts run at the CPU's speed, FCFS IO on the CPU does not
+                    bool p_ret = proc->step(proc->state == ProcessState::running ? work() : 1);
                     bool t_ret = false;
                     // only step if RR or (in case of FCFS) if state != processing/assigned_idle
                     if(!isFCFS() || (state != CPUState::processing && state != CPUState::assigned_idle)) {
@@ -132,7 +272,8 @@ namespace Simulation {
                             if(p_ret || t_ret) {
                                 // FCFS has additional checks
                                 if(isFCFS()) {
-                                    if(proc->bursts.empty()) {
+                                    // with IO devices, the IO burst goes to a device instead of being stepped here
+                                    if(proc->bursts.empty() || (proc->state == ProcessState::running && !settings.IO_DEVICES.empty())) {
                                         deassign();
                                     } else {
                                         // if not de-assigned, swap state of process and cpu
@@ -147,7 +288,6 @@ namespace Simulation {
                             break;
                         case CPUState::switching_out:
                             if(t_ret) {
-                                //std::cout << "done switching out" << std::endl;
                                 // set the CPU to idle
                                 t = Timer<CPUState>(0, CPUState::idle);
                                 proc = nullptr;
@@ -157,7 +297,6 @@ namespace Simulation {
                             break;
                         case CPUState::switching_in:
                             if(t_ret) {
-                                //std::cout << "done switching in" << std::endl;
                                 if(isFCFS()) {
                                     // state = running if RR or (in case of FCFS) if isProcessing()
                                     // else (FCFS IO) state = blocked
@@ -178,144 +317,644 @@ namespace Simulation {
 
     class System {
         private:
+            // every container below allocates from mem, which is the arena in MemoryMode::arena
+            // the arena must outlive the containers, so it is declared first
+            MemoryMode mode;
+            SimulationArena arena;
+            std::pmr::memory_resource* mem;
+            // each part of the System allocates from mem through its own TrackingResource, which counts only with MEMORY_ACCOUNTING
+            AllocationCount alloc_total;
+            std::array<TrackingResource, MEMORY_PART_COUNT> tracked;
+
             SystemSettings settings;
             std::vector<CPU> cpus;
-            std::map<PID, PCB> PCB_table;
-            std::list<PCB> retired;
+            // the CPUs holding or switching a process, in CPU order, which are stepped every Step
+            //      the CPUs between them are idle and are not stepped: they only take a process while one is ready,
+            //      and their idle Steps are accounted when they do (see CPU::idleUntil)
+            std::vector<CPUID> busy;
+            Step clock;                 // the next Step to simulate, up to which idle CPUs are accounted in outputStats
+            std::pmr::map<PID, PCB> PCB_table;
+            std::pmr::list<PCB> retired;
             ReadyPriorityQueue<PID> ready;
-            std::list<PID> blocked;      // can't use actual queue cuz this isn't actually FIFO
-            std::list<Timer<ProcessInit>> process_entry_timers;
+            // the ready queues of settings.SCHEDULER lottery, stride, edf and fair (only the scheduler's own queue is ever filled)
+            LotteryQueue lottery;
+            StrideQueue stride;
+            DeadlineQueue deadlines;
+            GroupQueue groups;
+            std::pmr::list<PID> blocked;      // can't use actual queue cuz this isn't actually FIFO
+            // with settings.IO_DEVICES, IO bursts queue on a device instead of sitting in blocked
+            //  nothing is stepped while a request waits or is served, the devices schedule completions in io_events
+            std::vector<IODevice> devices;
+            IOEventQueue io_events;
+            uint64_t io_seq;
+            StepSum io_inflight;        // requests queued or in service on any device
+            StepSum retired_count;
+
+            // optional progress telemetry, emitted every telemetry_steps simulated Steps and/or every telemetry_ms of wall-clock time
+            // disabled (the default) it costs one null check per Step
+            TelemetrySink* telemetry;
+            Step telemetry_steps;
+            unsigned telemetry_ms;
+            Step telemetry_last_step;
+            std::chrono::steady_clock::time_point telemetry_last_time;
+            // the clock is only read every TELEMETRY_CLOCK_INTERVAL Steps
+            static constexpr Step TELEMETRY_CLOCK_INTERVAL = 64;
+            // only consulted with TRACE_LEVEL > 0 (see debug.h)
+            TraceSink* trace_sink;
+            // the jobs of the periodic tasks passed to simulate(), which arrivals points into
+            std::vector<ProcessPlan> released;
+            // plans passed to simulate(), ordered by arrival
+            // only the cursor moves each step, rather than stepping a Timer for every process that has yet to arrive
+            std::pmr::vector<const ProcessPlan*> arrivals;
+            typename std::pmr::vector<const ProcessPlan*>::size_type next_arrival;
+
+            // open-system mode (see simulateOpen)
+            // retired processes are folded into steady instead of being kept in retired
+            bool open_system;
+            SteadyStateStats steady;
+            static constexpr std::size_t CPU_HISTORY_LIMIT = 256;
+            // number of ready processes (of the top priority) an affinity-aware dispatch looks through
+            static constexpr std::size_t AFFINITY_WINDOW = 16;
+
+            // settings.PREEMPTIVE under Scheduler::priority (the other schedulers never preempt)
+            bool preemptive;
+            // with preemptive: (priority, CPU) of every CPU holding a process, from assign() until it starts switching out
+            //  the last entry is the lowest-priority holder, the one a preemption picks
+            //  with aging, the priority is the effective one at dispatch, so an aged process is not at once preempted by a fresh one
+            using running_set = std::set<std::pair<Priority, CPUID>>;
+            running_set running;
+            std::vector<typename running_set::iterator> running_at;     // entry of each CPU, running.end() while it holds nothing
+
+            // drops cpu from running once it has let go of its process
+            void release(const CPU& cpu) {
+                auto& at = running_at[cpu.getID()];
+                if(at != running.end() && (cpu.getState() == CPUState::switching_out || !cpu.assigned())) {
+                    running.erase(at);
+                    at = running.end();
+                }
+            }
+
+            // preempts the lowest-priority running processes while a ready process outranks them
+            // CPUs which hold nothing (idle or switching out) take the first ready processes anyway, so those are skipped
+            // ready processes are visited in dispatch order, which with aging is by effective priority, so an aged process on any level can preempt
+            void preempt(Step s) {
+                std::size_t free = cpus.size() - running.size();
+                ready.forEachOrdered([&](PID, Priority prio, Step since) {
+                    if(running.empty())
+                        return false;
+                    if(free > 0) {
+                        free--;
+                        return true;
+                    }
+                    auto lowest = std::prev(running.end());
+                    if(ready.effectivePriority(prio, since, s) >= (*lowest).first)
+                        return false;
+                    // the preempted CPU takes this ready process once it has switched out
+                    cpus[(*lowest).second].preempt();
+                    trace(s, TraceKind::preempt, cpus[(*lowest).second].getPID(), (*lowest).second);
+                    running_at[(*lowest).second] = running.end();
+                    running.erase(lowest);
+                    return true;
+                });
+            }
+
+            // queues pcb on the scheduler's ready queue, its wait starting at since
+            void makeReady(PCB& pcb, Step since) {
+                pcb.state = ProcessState::ready;
+                trace(since, TraceKind::ready, pcb.id);
+                switch(settings.SCHEDULER) {
+                    case Scheduler::priority:
+                        ready.push(pcb.id, pcb.prio, since);
+                        break;
+                    case Scheduler::lottery:
+                        lottery.push(pcb.id, pcb.stats.tickets, since);
+                        break;
+                    case Scheduler::stride:
+                        stride.push(pcb.id, pcb.stats.tickets, pcb.ran, since);
+                        break;
+                    case Scheduler::edf:
+                        deadlines.push(pcb.id, pcb.stats.hasDeadline() ? pcb.stats.getDue() : DeadlineQueue::NO_DEADLINE, since);
+                        break;
+                    case Scheduler::fair:
+                        groups.push(pcb.id, pcb.stats.group, pcb.stats.tickets, since);
+                        break;
+                }
+            }
+            std::size_t readyCount() const {
+                return ready.size() + lottery.size() + stride.size() + deadlines.size() + groups.size();
+            }
+            // a process can be dispatched (the processes of throttled groups cannot)
+            bool anyReady() const {
+                return !ready.empty() || !lottery.empty() || !stride.empty() || !deadlines.empty() || groups.available() > 0;
+            }
+            // removes the process cpu should run next (only meaningful if anyReady())
+            ReadyPriorityQueue<PID>::Entry takeReady(const CPU& cpu) {
+                switch(settings.SCHEDULER) {
+                    case Scheduler::lottery:
+                        return lottery.take();
+                    case Scheduler::stride:
+                        return stride.take();
+                    case Scheduler::edf:
+                        return deadlines.take();
+                    case Scheduler::fair:
+                        return groups.take();
+                    case Scheduler::priority:
+                        break;
+                }
+                if(settings.AFFINITY_DISPATCH) {
+                    // prefer a process which last ran here, but only within the highest priority level
+                    CPUID here = cpu.getID();
+                    return ready.popPreferred([this, here](PID id){ return PCB_table.at(id).last_cpu == here; }, AFFINITY_WINDOW);
+                }
+                return ready.take();
+            }
+
+            std::pmr::memory_resource* resource(MemoryPart m) {
+                return &tracked[static_cast<std::size_t>(m)];
+            }
+
+            // removes a finished process from the table
+            void retire(typename std::pmr::map<PID, PCB>::iterator it, Step s) {
+                retired_count++;
+                trace(s, TraceKind::retire, (*it).first);
+                stride.forget((*it).first);
+                groups.forget((*it).first);
+                if(open_system) {
+                    ProcessSummary sum = (*it).second.stats.summarize();
+                    if(steady.record(sum.turnaround, sum.wait, sum.response, s)) {
+                        StepSum processed = 0;
+                        for(auto& cpu : cpus) {
+                            processed += cpu.processingSteps();
+                            // an open run has no natural end, so CPU histories are collapsed before they grow large
+                            cpu.compactHistory(CPU_HISTORY_LIMIT);
+                        }
+                        steady.closeBatch(processed);
+                    }
+                } else {
+                    retired.push_back((*it).second);
+                }
+                PCB_table.erase(it);
+            }
 
             void addProcess(const ProcessInit& pi, Step curr) {
-                // add to table
-                PCB_table.emplace(pi.id, PCB(pi, curr));
+                if(settings.SCHEDULER == Scheduler::fair && !groups.isLeaf(pi.group))
+                    throw "Process " + std::to_string(pi.id) + " is not in a leaf group";
+                // add to table (constructed in place so the PCB picks up the table's memory resource)
+                PCB_table.emplace(std::piecewise_construct, std::forward_as_tuple(pi.id), std::forward_as_tuple(pi, curr));
+                trace(curr, TraceKind::arrive, pi.id);
                 // add to appropriate queue
                 if(pi.bursts.isProcessing()) {
-                    ready.push(pi.id, pi.prio);
+                    // created after this step's ready processes were counted, so it starts waiting next step
+                    makeReady(PCB_table.at(pi.id), curr + 1);
                 } else {
-                    PCB_table.at(pi.id).state = ProcessState::blocked;
-                    blocked.push_back(pi.id);
+                    // created after this step's blocked processes were stepped, so IO starts next step
+                    block(PCB_table.at(pi.id), curr + 1);
                 }
             }
 
+            // starts the IO burst at the front of pcb's bursts, its first step of IO being first
+            void block(PCB& pcb, Step first) {
+                trace(first, TraceKind::block, pcb.id);
+                if(devices.empty()) {
+                    pcb.state = ProcessState::blocked;
+                    blocked.push_back(pcb.id);
+                } else {
+                    pcb.state = ProcessState::io_waiting;
+                    io_inflight++;
+                    devices[pcb.id % devices.size()].submit({pcb.id, pcb.bursts.front(), first, pcb.prio}, io_events, io_seq);
+                }
+            }
+
+            // creates the CPUs and IO devices for the current settings
+            void build() {
+                // everything was released by clearState(), so the counts start from nothing
+                alloc_total = AllocationCount();
+                for(auto& t : tracked)
+                    t.enable(settings.MEMORY_ACCOUNTING);
+                // reserved up front: a CPU is copied when the vector grows, and the copy's History would allocate from the default resource rather than this System's
+                cpus.reserve(settings.CPU_COUNT);
+                while(cpus.size() < settings.CPU_COUNT)
+                    cpus.emplace_back(settings, cpus.size(), resource(MemoryPart::cpu_histories));
+                busy.reserve(settings.CPU_COUNT);
+                running_at.assign(cpus.size(), running.end());
+                preemptive = settings.PREEMPTIVE && settings.SCHEDULER == Scheduler::priority;
+                ready.setAging(settings.AGING_INTERVAL);
+                // restarts the draws (the queue is empty here, clearState() ran under the previous settings)
+                lottery.clear(settings.LOTTERY_SEED);
+                groups.configure(settings.GROUPS);
+                for(auto& d : settings.IO_DEVICES)
+                    devices.emplace_back(devices.size(), d);
+            }
+
             void clearState() {
                 PCB_table.clear();
                 retired.clear();
                 ready.clear();
+                lottery.clear();
+                stride.clear();
+                deadlines.clear();
+                groups.clear();
                 blocked.clear();
-                process_entry_timers.clear();
+                devices.clear();
+                io_events = IOEventQueue();
+                io_seq = 0;
+                io_inflight = 0;
+                retired_count = 0;
+                telemetry_last_step = 0;
+                telemetry_last_time = std::chrono::steady_clock::now();
+                // swap rather than clear() so the vector's storage is returned before the arena is reset
+                std::pmr::vector<const ProcessPlan*>(resource(MemoryPart::queues)).swap(arrivals);
+                released.clear();
+                next_arrival = 0;
+                open_system = false;
+                steady = SteadyStateStats();
                 cpus.clear();
+                busy.clear();
+                clock = 0;
+                running.clear();
+                running_at.clear();
+                // everything is empty, so the previous run's memory can be dropped in one go
+                if(mode == MemoryMode::arena)
+                    arena.reset();
+            }
+
+            // advances every CPU, blocked process and ready process by one step
+            void step(Step s) {
+                if(preemptive)
+                    preempt(s);
+                if(settings.SCHEDULER == Scheduler::fair)
+                    groups.refill(s);
+
+                // step the busy CPUs, and offer ready processes to the idle CPUs between them, in CPU order
+                std::size_t i = 0;
+                CPUID at = 0;       // the CPUs before at have been stepped or offered a process
+                while(true) {
+                    CPUID next = i < busy.size() ? busy[i] : cpus.size();
+                    if(at < next && anyReady()) {
+                        CPU& cpu = cpus[at++];
+                        // its idle Steps so far, this one included, were skipped
+                        cpu.idleUntil(s + 1);
+                        dispatch(cpu, s);
+                        busy.insert(busy.begin() + i++, cpu.getID());
+                        continue;
+                    }
+                    if(i == busy.size())
+                        break;
+                    at = next + 1;
+
+                    CPU& cpu = cpus[next];
+                    // step and check if needs a new process
+                    bool needs_process = cpu.step();
+                    if(preemptive)
+                        release(cpu);
+                    if(!needs_process) {
+                        i++;
+                        continue;
+                    }
+                    // move CPU's last process (specific action depends on state)
+                    PID id = cpu.getPID();
+                    const PCB& pcb = PCB_table.at(id);
+                    trace(s, TraceKind::switched_out, id, cpu.getID());
+                    if(settings.SCHEDULER == Scheduler::fair)
+                        groups.charge(id, pcb.ran, s);
+                    if(pcb.state == ProcessState::exit) {
+                        // delete PCB (and save to retired vector)
+                        retire(PCB_table.find(id), s);
+                    } else if(pcb.bursts.isProcessing()) {
+                        // add to ready RPQ
+                        makeReady(PCB_table.at(id), s);
+                    } else {
+                        // add to blocked list (blocked processes are stepped later this step)
+                        block(PCB_table.at(id), s);
+                    }
+
+                    // check if there's a process available
+                    if(anyReady()) {
+                        dispatch(cpu, s);
+                        i++;
+                    } else {
+                        // before at, so it is not offered a process again this Step
+                        cpu.park(s + 1);
+                        busy.erase(busy.begin() + i);
+                    }
+                }
+
+                // step all blocked processes
+                for(auto it = blocked.begin(); it != blocked.end(); ) {
+                    // get iterator to pcb
+                    PID id = *it;
+                    auto pcb_it = PCB_table.find(id);
+                    // step and check
+                    if((*pcb_it).second.step()) {
+                        // check for being completely finished
+                        if((*pcb_it).second.bursts.empty()) {
+                            // delete from PCB table and save to retired
+                            retire(pcb_it, s);
+                        } else {
+                            // add to ready list (and update state to ready)
+                            makeReady((*pcb_it).second, s);
+                        }
+                        // remove from blocked list (and get new iterator)
+                        it = blocked.erase(it);
+                    } else {
+                        // only increment if not removed from blocked list
+                        it++;
+                    }
+                }
+
+                // finish every device request whose last step of service is this one
+                while(!io_events.empty() && io_events.top().finish == s) {
+                    IOEvent e = io_events.top();
+                    io_events.pop();
+                    io_inflight--;
+                    devices[e.device].complete(s, io_events, io_seq);
+
+                    auto pcb_it = PCB_table.find(e.req.id);
+                    PCB& pcb = (*pcb_it).second;
+                    if(e.waited > 0)
+                        pcb.stats.hist.push(ProcessState::io_waiting, e.waited);
+                    pcb.stats.hist.push(ProcessState::blocked, e.req.length);
+                    pcb.popBurst();
+                    if(pcb.bursts.empty()) {
+                        retire(pcb_it, s);
+                    } else {
+                        makeReady(pcb, s);
+                    }
+                }
+
+                // ready processes are not stepped: their wait is pushed to their History when they are dispatched
+
+                clock = s + 1;
+
+                if constexpr(TRACE_LEVEL > 1)
+                    checkInvariants(s);
+            }
+
+            // assigns the next ready process to cpu (there must be one)
+            void dispatch(CPU& cpu, Step s) {
+                // remove process from ready queue
+                ReadyPriorityQueue<PID>::Entry e = takeReady(cpu);
+                PCB& pcb = PCB_table.at(e.val);
+                // ready time is recorded once, when the wait ends, rather than stepped into the History every step
+                if(s > e.since)
+                    pcb.stats.hist.push(ProcessState::ready, s - e.since);
+                cpu.assign(&pcb);
+                trace(s, TraceKind::dispatch, pcb.id, cpu.getID());
+                if(preemptive)
+                    running_at[cpu.getID()] = running.insert({ready.effectivePriority(pcb.prio, e.since, s), cpu.getID()}).first;
+            }
+
+            // sends an event to trace_sink (compiled away at TRACE_LEVEL 0)
+            void trace(Step s, TraceKind kind, PID id, CPUID cpu = TraceEvent::NO_CPU) {
+                if constexpr(TRACE_LEVEL > 0) {
+                    if(trace_sink)
+                        trace_sink->event({s, kind, id, cpu});
+                }
+            }
+
+            // throws if the System's containers disagree with each other or with the PCB states
+            //      every live process is in exactly one place: a ready queue, blocked, a device, or a CPU
+            //      and its state matches that place
+            void checkInvariants(Step s) const {
+                auto fail = [s](std::string what) {
+                    throw "Invariant violated at step " + std::to_string(s) + ": " + what;
+                };
+                std::map<PID, ProcessState> seen;   // the state each process's place implies
+                auto place = [&](PID id, ProcessState expect, const char* where, CPUID cpu = TraceEvent::NO_CPU) {
+                    auto name = [&]() { return std::string(where) + (cpu == TraceEvent::NO_CPU ? "" : " " + std::to_string(cpu)); };
+                    if(PCB_table.find(id) == PCB_table.end())
+                        fail(name() + " holds unknown process " + std::to_string(id));
+                    if(!seen.emplace(id, expect).second)
+                        fail("process " + std::to_string(id) + " is in " + name() + " and somewhere else");
+                };
+                auto readyAt = [&](PID id) { place(id, ProcessState::ready, "the ready queue"); };
+                ready.forEach(readyAt);
+                lottery.forEach(readyAt);
+                stride.forEach(readyAt);
+                groups.forEach(readyAt);
+                deadlines.forEach(readyAt);
+                for(PID id : blocked)
+                    place(id, ProcessState::blocked, "the blocked list");
+                for(auto& cpu : cpus) {
+                    if(cpu.assigned() != std::binary_search(busy.begin(), busy.end(), cpu.getID()))
+                        fail("CPU " + std::to_string(cpu.getID()) + " is " + to_string(cpu.getState()) + " but " + (cpu.assigned() ? "not " : "") + "on the busy list");
+                    switch(cpu.getState()) {
+                        case CPUState::idle:
+                            break;
+                        case CPUState::switching_in:
+                            place(cpu.getPID(), ProcessState::switching, "CPU", cpu.getID());
+                            break;
+                        case CPUState::processing:
+                            place(cpu.getPID(), ProcessState::running, "CPU", cpu.getID());
+                            break;
+                        case CPUState::assigned_idle:
+                            place(cpu.getPID(), ProcessState::blocked, "CPU", cpu.getID());
+                            break;
+                        case CPUState::switching_out:
+                            // exit or switching, checked below
+                            place(cpu.getPID(), ProcessState::exit, "CPU", cpu.getID());
+                            break;
+                    }
+                }
+
+                StepSum waiting = 0;
+                for(auto& it : PCB_table) {
+                    const PCB& pcb = it.second;
+                    if(pcb.state == ProcessState::io_waiting) {
+                        waiting++;
+                        if(seen.count(pcb.id))
+                            fail("process " + std::to_string(pcb.id) + " is waiting on IO but queued elsewhere");
+                        continue;
+                    }
+                    auto at = seen.find(pcb.id);
+                    if(at == seen.end())
+                        fail("process " + std::to_string(pcb.id) + " (" + to_string(pcb.state) + ") is nowhere");
+                    ProcessState expect = (*at).second;
+                    bool ok = pcb.state == expect || (expect == ProcessState::exit && pcb.state == ProcessState::switching);
+                    if(!ok)
+                        fail("process " + std::to_string(pcb.id) + " is " + to_string(pcb.state) + " but placed as " + to_string(expect));
+                }
+                if(waiting != io_inflight)
+                    fail(std::to_string(waiting) + " processes wait on IO but " + std::to_string(io_inflight) + " requests are in flight");
+                if(readyCount() != std::size_t(std::count_if(seen.begin(), seen.end(), [](const std::pair<const PID, ProcessState>& p) { return p.second == ProcessState::ready; })))
+                    fail("the ready queue's size does not match its contents");
+            }
+
+            // emits a snapshot if a telemetry interval has passed
+            void pollTelemetry(Step s) {
+                bool due = telemetry_steps > 0 && s - telemetry_last_step >= telemetry_steps;
+                std::chrono::steady_clock::time_point now;
+                if(!due && telemetry_ms > 0 && s % TELEMETRY_CLOCK_INTERVAL == 0) {
+                    now = std::chrono::steady_clock::now();
+                    due = now - telemetry_last_time >= std::chrono::milliseconds(telemetry_ms);
+                }
+                if(!due)
+                    return;
+                if(now == std::chrono::steady_clock::time_point())
+                    now = std::chrono::steady_clock::now();
+
+                TelemetrySnapshot snap = {s, PCB_table.size(), readyCount(), blocked.size() + io_inflight, retired_count, {0, 0, 0, 0, 0}, 0};
+                for(auto& cpu : cpus)
+                    snap.cpu_states[static_cast<std::size_t>(cpu.getState())]++;
+                double secs = std::chrono::duration<double>(now - telemetry_last_time).count();
+                snap.ticks_per_second = secs > 0 ? (s - telemetry_last_step) / secs : 0;
+                telemetry->emit(snap);
+
+                telemetry_last_step = s;
+                telemetry_last_time = now;
             }
 
         public:
             void updateSettings(SystemSettings sett) {
                 clearState();
                 settings = sett;
-                while(cpus.size() < settings.CPU_COUNT)
-                    cpus.emplace_back(settings, cpus.size());
+                build();
             }
 
-            System(SystemSettings sett = SystemSettings()) {
+            System(SystemSettings sett = SystemSettings(), MemoryMode mm = MemoryMode::heap) :
+                mode(mm),
+                mem(mm == MemoryMode::arena ? static_cast<std::pmr::memory_resource*>(&arena) : std::pmr::get_default_resource()),
+                tracked{{{mem, &alloc_total}, {mem, &alloc_total}, {mem, &alloc_total}, {mem, &alloc_total}}},
+                clock(0),
+                PCB_table(resource(MemoryPart::live_processes)),
+                retired(resource(MemoryPart::retired)),
+                ready(MAX_PRIO, resource(MemoryPart::queues)),
+                groups(resource(MemoryPart::queues)),
+                blocked(resource(MemoryPart::queues)),
+                io_seq(0),
+                io_inflight(0),
+                retired_count(0),
+                telemetry(nullptr),
+                telemetry_steps(0),
+                telemetry_ms(0),
+                telemetry_last_step(0),
+                trace_sink(nullptr),
+                arrivals(resource(MemoryPart::queues)),
+                next_arrival(0),
+                open_system(false),
+                preemptive(false) {
                 updateSettings(sett);
             }
+            System(const System&) = delete;
+            System& operator=(const System&) = delete;
+
+            MemoryMode getMemoryMode() const {
+                return mode;
+            }
+
+            // emit a TelemetrySnapshot to sink every steps simulated Steps and/or every ms of wall-clock time (0 disables either)
+            // a null sink turns telemetry off, the sink must outlive any simulation it watches
+            void setTelemetry(TelemetrySink* sink, Step steps, unsigned ms = 0) {
+                telemetry = sink;
+                telemetry_steps = steps;
+                telemetry_ms = ms;
+            }
+
+            // send scheduling events to sink (only with TRACE_LEVEL > 0, otherwise the sink is never called)
+            // a null sink turns tracing off, the sink must outlive any simulation it watches
+            void setTraceSink(TraceSink* sink) {
+                trace_sink = sink;
+            }
 
             // BIG DADDY
-            void simulate(std::vector<ProcessPlan> data_files) {
-                // for each ProcessPlan, start ProcessEntry timer
-                for(auto& plan : data_files)
-                    process_entry_timers.emplace_back(plan.arrival, plan.init);
-                
+            void simulate(const std::vector<ProcessPlan>& data_files) {
+                load(data_files);
                 // Simulate steps until max reached or all processes finish
-                for(Step s = 0; s < std::numeric_limits<Step>::max() && !(PCB_table.empty() && process_entry_timers.empty()); s++) {
-                    // for each CPU
-                    for(auto &cpu : cpus) {
-                        // save if CPU was already idle (have to save this cuz step() will change state to idle when it returns true)
-                        bool already_idle = !cpu.assigned();
-                        // If not already idle, step and check if needs a new process
-                        if(cpu.step() || already_idle) {
-                            // don't move CPU's last process if it was already idle
-                            // already idle CPUs have either never had a process, or already had their previous process handled on a previous loop
-                            if(!already_idle) {
-                                // move CPU's last process (specific action depends on state)
-                                PID id = cpu.getPID();
-                                PCB pcb = PCB_table.at(id);
-                                //printPCB(pcb, 4);
-                                if(pcb.state == ProcessState::exit) {
-                                    //std::cout << "Deleting: " << id << std::endl;
-                                    // delete PCB (and save to retired vector)
-                                    auto it = PCB_table.find(id);
-                                    retired.push_back((*it).second);
-                                    PCB_table.erase(it);
-                                } else if(pcb.bursts.isProcessing()) {
-                                    //std::cout << "Adding to ready: " << id << std::endl;
-                                    // add to ready RPQ
-                                    ready.push(id, pcb.prio);
-                                    PCB_table.at(id).state = ProcessState::ready;
-                                } else {
-                                    //std::cout << "Adding to blocked: " << id << std::endl;
-                                    // add to blocked list
-                                    blocked.push_back(id);
-                                    PCB_table.at(id).state = ProcessState::blocked;
-                                }
-                                //printPCB(pcb);
-                            }
+                for(Step s = 0; s < std::numeric_limits<Step>::max() && !finished(); s++)
+                    tick(s);
+            }
 
-                            // check if there's a process available
-                            if(!ready.empty()) {
-                                // assign process
-                                //std::cout << "Assigning " << ready.front() << " to CPU " << cpun << std::endl;
+            // simulate() one step at a time, for a driver which interleaves several Systems (see ParallelSystem)
+            // the plans must outlive the run
+            void load(const std::vector<ProcessPlan>& data_files) {
+                // order the ProcessPlans by arrival (stable, so simultaneous arrivals keep their plan order)
+                bool periodic = std::any_of(data_files.begin(), data_files.end(), [](const ProcessPlan& pl){ return pl.init.period > 0 && pl.releases > 1; });
+                if(periodic)
+                    released = releaseJobs(data_files);
+                for(auto& plan : periodic ? released : data_files)
+                    arrivals.push_back(&plan);
+                std::stable_sort(arrivals.begin() + next_arrival, arrivals.end(), [](const ProcessPlan* a, const ProcessPlan* b){ return a->arrival < b->arrival; });
+            }
+            bool finished() const {
+                return PCB_table.empty() && next_arrival == arrivals.size();
+            }
+            void tick(Step s) {
+                step(s);
 
-                                cpu.assign(&(PCB_table.at(ready.front())));
-                                // remove process from ready queue
-                                ready.pop();
-                            }
-                        }
-                    }
+                // create every Process arriving this step
+                // (an arrival of a steps fires on step a-1, as if a ProcessEntry Timer started at step 0)
+                while(next_arrival < arrivals.size() && arrivals[next_arrival]->arrival <= s + 1)
+                    addProcess(arrivals[next_arrival++]->init, s);
 
-                    // step all blocked processes
-                    for(auto it = blocked.begin(); it != blocked.end(); ) {
-                        // get iterator to pcb
-                        PID id = *it;
-                        auto pcb_it = PCB_table.find(id);
-                        // step and check
-                        if((*pcb_it).second.step()) {
-                            // check for being completely finished
-                            if((*pcb_it).second.bursts.empty()) {
-                                // delete from PCB table and save to retired
-                                retired.push_back((*pcb_it).second);
-                                PCB_table.erase(pcb_it);
-                            } else {
-                                // add to ready list
-                                ready.push(id, (*pcb_it).second.prio);
-                                // update state to ready
-                                (*pcb_it).second.state = ProcessState::ready;
-                            }
-                            // remove from blocked list (and get new iterator)
-                            it = blocked.erase(it);
-                        } else {
-                            // only increment if not removed from blocked list
-                            it++;
-                        }
-                    }
+                if(telemetry)
+                    pollTelemetry(s);
+            }
 
-                    // step all ready processes
-                    for(auto id : ready)
-                        PCB_table.at(id).step();
-                    
-                    // step ProcessEntry Timers
-                    for(auto it = process_entry_timers.begin(); it != process_entry_timers.end(); ) {
-                        // step and check
-                        if((*it).step()) {
-                            // create Process
-                            addProcess((*it).getData(), s);
-                            // delete Timer (and get new iterator)
-                            it = process_entry_timers.erase(it);
-                        } else {
-                            // only increment if Timer is not deleted
-                            it++;
+            // load balancing between Systems: the ready process this System would dispatch next moves to another System
+            std::size_t readyProcesses() const {
+                return settings.SCHEDULER == Scheduler::fair ? groups.available() : readyCount();
+            }
+            CPUID idleCPUs() const {
+                return cpus.size() - busy.size();
+            }
+            // removes the next ready process (there must be one), returning it with the step its wait began
+            std::pair<PCB, Step> donate() {
+                ReadyPriorityQueue<PID>::Entry e = settings.SCHEDULER == Scheduler::priority ? ready.take() : takeReady(cpus.front());
+                auto it = PCB_table.find(e.val);
+                std::pair<PCB, Step> out((*it).second, e.since);
+                stride.forget(e.val);
+                groups.forget(e.val);
+                PCB_table.erase(it);
+                return out;
+            }
+            // queues a donated process as of now, which counts as migrated when it next switches in
+            //      the wait since it was made ready on the donor goes into its History now, so it counts in the stats
+            //      but not in the queue, which keeps the ready queues FIFO in since (which aging relies on)
+            void adopt(const PCB& pcb, Step since, Step now) {
+                PCB& p = (*PCB_table.emplace(std::piecewise_construct, std::forward_as_tuple(pcb.id), std::forward_as_tuple(pcb)).first).second;
+                p.last_cpu = PCB::MIGRATED;
+                if(now > since)
+                    p.stats.hist.push(ProcessState::ready, now - since);
+                stride.join(p.id, p.ran);
+                groups.join(p.id, p.ran);
+                makeReady(p, now);
+            }
+
+            // open system: processes keep arriving from arrivals (with bodies drawn from seed) until the horizon
+            // retired processes only feed the steady-state batches, see outputSteadyState()
+            void simulateOpen(ArrivalProcess& arrivals, Step horizon, uint64_t seed = 0) {
+                clearState();
+                build();
+                open_system = true;
+                steady.settings = settings;
+
+                SeededRandom src(seed);
+                StepSum arrived = 0;
+                PID next_pid = 0;
+                bool pending = !arrivals.done();
+                Step next_time = pending ? arrivals.next() : 0;
+                for(Step s = 0; s < horizon; s++) {
+                    step(s);
+
+                    // same convention as simulate(): an arrival at step a is created on step a-1
+                    while(pending && next_time <= s + 1) {
+                        // PIDs are recycled, skipping any still live
+                        if(PCB_table.size() > std::numeric_limits<PID>::max())
+                            throw "PID space exhausted at step " + std::to_string(s) + " (" + std::to_string(PCB_table.size()) + " live processes), build with SIMULATION_SCALE";
+                        while(PCB_table.find(next_pid) != PCB_table.end())
+                            next_pid++;
+                        addProcess(generateProcess(next_pid++, src), s);
+                        arrived++;
+                        if((pending = !arrivals.done())) {
+                            Step gap = arrivals.next();
+                            next_time = gap > std::numeric_limits<Step>::max() - next_time ? std::numeric_limits<Step>::max() : next_time + gap;
                         }
                     }
+
+                    if(telemetry)
+                        pollTelemetry(s);
                 }
+                steady.finish(horizon, arrived, PCB_table.size());
             }
 
             // simulate with current settings
@@ -323,14 +962,35 @@ namespace Simulation {
                 simulate(generateDataFiles(settings.PROCESS_COUNT));
             }
 
+            SteadyStateStats outputSteadyState() const {
+                return steady;
+            }
+
             SimulationStats outputStats() {
                 std::vector<ProcessStats> ps;
                 std::vector<CPUStats> cs;
                 for(auto& p : retired)
                     ps.push_back(p.stats);
-                for(auto& c : cpus)
+                for(auto& c : cpus) {
+                    // idle CPUs are only accounted up to their last dispatch
+                    if(!c.assigned())
+                        c.idleUntil(clock);
                     cs.push_back(c.getStats());
-                return SimulationStats(settings, ps.begin(), ps.end(), cs.begin(), cs.end());
+                }
+                SimulationStats out(settings, ps.begin(), ps.end(), cs.begin(), cs.end());
+                if(settings.SCHEDULER == Scheduler::fair && !settings.GROUPS.empty()) {
+                    StepSum end = cs.empty() ? 0 : cs.front().hist.duration();
+                    for(std::size_t g = 0; g < groups.groupCount(); g++)
+                        out.gs.push_back({g, groups.getRan(g), groups.getThrottles(g), groups.getThrottledSteps(g, Step(end))});
+                }
+                if(settings.MEMORY_ACCOUNTING) {
+                    out.memory.accounted = true;
+                    for(std::size_t i = 0; i < MEMORY_PART_COUNT; i++)
+                        out.memory.parts[i] = tracked[i].getCount();
+                    out.memory.total = alloc_total;
+                    out.memory.stats_bytes = out.approxBytes();
+                }
+                return out;
             }
     };
 }
@@ -0,0 +1,111 @@
+// defines the progress snapshots a System can emit while it simulates, and the sinks which receive them
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "typedefs.h"
+#include <atomic>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+namespace Simulation {
+    const std::size_t CPU_STATE_COUNT = 5;
+
+    struct TelemetrySnapshot {
+        Step step;
+        StepSum live;           // processes in the PCB table
+        StepSum ready;
+        StepSum blocked;        // doing IO or queued for an IO device
+        StepSum retired;
+        StepSum cpu_states[CPU_STATE_COUNT];    // number of CPUs in each CPUState, indexed by the enum
+        double ticks_per_second;
+    };
+
+    class TelemetrySink {
+        public:
+            virtual ~TelemetrySink() {}
+            virtual void emit(const TelemetrySnapshot& snap) = 0;
+    };
+
+    // one JSON object per line, written straight to a file descriptor (a file, a pipe, stderr...)
+    class JsonLinesTelemetry : public TelemetrySink {
+        private:
+            int fd;
+        public:
+            JsonLinesTelemetry(int ff = STDERR_FILENO) : fd(ff) {}
+
+            void emit(const TelemetrySnapshot& s) override {
+                char buf[512];
+                int n = snprintf(buf, sizeof(buf),
+                    "{\"step\":%llu,\"live\":%llu,\"ready\":%llu,\"blocked\":%llu,\"retired\":%llu,"
+                    "\"cpus\":{\"idle\":%llu,\"assigned_idle\":%llu,\"processing\":%llu,\"switching_out\":%llu,\"switching_in\":%llu},"
+                    "\"ticks_per_second\":%.1f}\n",
+                    (unsigned long long)(s.step), (unsigned long long)(s.live), (unsigned long long)(s.ready),
+                    (unsigned long long)(s.blocked), (unsigned long long)(s.retired),
+                    (unsigned long long)(s.cpu_states[0]), (unsigned long long)(s.cpu_states[1]), (unsigned long long)(s.cpu_states[2]),
+                    (unsigned long long)(s.cpu_states[3]), (unsigned long long)(s.cpu_states[4]),
+                    s.ticks_per_second);
+                if(n > 0) {
+                    ssize_t written = write(fd, buf, std::min<std::size_t>(n, sizeof(buf) - 1));
+                    (void)(written);
+                }
+            }
+    };
+
+    // a ring of snapshots in POSIX shared memory, which an external viewer maps and polls
+    //      layout: RingHeader, then capacity TelemetrySnapshots
+    //      the writer fills slot (written % capacity) and then publishes it by incrementing written
+    //      a reader copies slot i while written - i < capacity, and rereads written afterwards to detect an overwrite
+    class SharedRingTelemetry : public TelemetrySink {
+        public:
+            struct RingHeader {
+                std::atomic<uint64_t> written;
+                uint64_t capacity;
+            };
+        private:
+            std::string name;
+            std::size_t bytes;
+            RingHeader* header;
+            TelemetrySnapshot* slots;
+        public:
+            SharedRingTelemetry(std::string nn, uint64_t capacity = 1024) : name(nn), bytes(sizeof(RingHeader) + capacity * sizeof(TelemetrySnapshot)) {
+                // checked before the segment is created, so a bad capacity leaves nothing behind
+                if(capacity == 0)
+                    throw "Shared memory ring " + name + " needs a capacity of at least one snapshot";
+                int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+                if(fd < 0)
+                    throw "Error opening shared memory " + name;
+                if(ftruncate(fd, bytes) != 0) {
+                    close(fd);
+                    throw "Error sizing shared memory " + name;
+                }
+                void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                close(fd);
+                if(p == MAP_FAILED)
+                    throw "Error mapping shared memory " + name;
+                header = new (p) RingHeader;
+                header->written.store(0);
+                header->capacity = capacity;
+                slots = reinterpret_cast<TelemetrySnapshot*>(header + 1);
+            }
+            SharedRingTelemetry(const SharedRingTelemetry&) = delete;
+            SharedRingTelemetry& operator=(const SharedRingTelemetry&) = delete;
+            ~SharedRingTelemetry() {
+                munmap(header, bytes);
+                shm_unlink(name.c_str());
+            }
+
+            void emit(const TelemetrySnapshot& s) override {
+                uint64_t i = header->written.load(std::memory_order_relaxed);
+                slots[i % header->capacity] = s;
+                header->written.store(i + 1, std::memory_order_release);
+            }
+    };
+}
+
+#endif
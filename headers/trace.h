@@ -0,0 +1,305 @@
+// defines CompressedTrace, a compact encoding of a History with a level-of-detail pyramid for viewers
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "typedefs.h"
+#include "stats.h"
+#include <vector>
+#include <array>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <stdint.h>
+
+namespace Simulation {
+    // a whole History packed into bytes, each period encoded by encodePeriod (see stats.h), as a History seals its older periods
+    // two structures let a viewer read part of a trace without decoding all of it
+    //      a seek index of (start step, byte offset) every INDEX_INTERVAL periods
+    //      a level-of-detail pyramid: level 0 splits the trace into buckets of bucket_size steps, each level above halves the bucket count
+    //          a bucket stores the share of its time spent in each state (in 1/255ths)
+    template<typename E>
+    class CompressedTrace {
+        public:
+            static constexpr std::size_t MAX_STATES = 1 << PERIOD_STATE_BITS;
+            static constexpr std::size_t INDEX_INTERVAL = 64;
+            // a pyramid is only built for traces with at least this many periods (shorter ones decode instantly)
+            static constexpr std::size_t LOD_MIN_PERIODS = 256;
+            static constexpr std::size_t LOD_MAX_BUCKETS = 1024;
+
+            struct Period {
+                E state;
+                StepSum start;
+                StepSum duration;
+            };
+            struct Bucket {
+                StepSum start;
+                StepSum length;
+                std::array<uint8_t, MAX_STATES> mix;    // share of the bucket in each state, out of 255
+
+                E dominant() const {
+                    return static_cast<E>(std::max_element(mix.begin(), mix.end()) - mix.begin());
+                }
+            };
+        private:
+            struct Checkpoint {
+                StepSum start;
+                uint64_t offset;
+            };
+
+            std::vector<uint8_t> bytes;
+            std::vector<Checkpoint> index;
+            uint64_t periods;
+            StepSum total;
+            StepSum bucket_size;        // steps per level-0 bucket (0 if there is no pyramid)
+            std::vector<std::vector<std::array<uint8_t, MAX_STATES>>> levels;
+
+            // decodes the period at offset pos, advancing pos past it
+            std::pair<E, StepSum> decode(uint64_t& pos) const {
+                return decodePeriod<E>(bytes.data(), pos);
+            }
+
+            static std::array<uint8_t, MAX_STATES> quantize(const std::array<StepSum, MAX_STATES>& sums) {
+                StepSum len = 0;
+                for(auto v : sums)
+                    len += v;
+                std::array<uint8_t, MAX_STATES> mix{};
+                for(std::size_t i = 0; i < MAX_STATES; i++)
+                    mix[i] = len == 0 ? 0 : (255 * sums[i] + len / 2) / len;
+                return mix;
+            }
+
+            void buildPyramid() {
+                // level 0 gets a power-of-two number of buckets, around a quarter of the periods
+                std::size_t count = 1;
+                while(count * 2 <= std::min<uint64_t>(LOD_MAX_BUCKETS, periods / 4))
+                    count *= 2;
+                bucket_size = (total + count - 1) / count;
+                count = (total + bucket_size - 1) / bucket_size;
+
+                // exact sums per bucket, one pass over the periods
+                std::vector<std::array<StepSum, MAX_STATES>> sums(count, std::array<StepSum, MAX_STATES>{});
+                forEach(0, total, [&](const Period& p) {
+                    StepSum at = p.start, end = p.start + p.duration;
+                    while(at < end) {
+                        std::size_t bkt = at / bucket_size;
+                        StepSum stop = std::min(end, (bkt + 1) * bucket_size);
+                        sums[bkt][static_cast<std::size_t>(p.state)] += stop - at;
+                        at = stop;
+                    }
+                });
+                // each level merges pairs of the level below
+                while(true) {
+                    std::vector<std::array<uint8_t, MAX_STATES>> level;
+                    for(auto& s : sums)
+                        level.push_back(quantize(s));
+                    levels.push_back(level);
+                    if(sums.size() <= 1)
+                        break;
+                    std::vector<std::array<StepSum, MAX_STATES>> up((sums.size() + 1) / 2, std::array<StepSum, MAX_STATES>{});
+                    for(std::size_t i = 0; i < sums.size(); i++)
+                        for(std::size_t st = 0; st < MAX_STATES; st++)
+                            up[i / 2][st] += sums[i][st];
+                    sums.swap(up);
+                }
+            }
+        public:
+            CompressedTrace() : periods(0), total(0), bucket_size(0) {}
+
+            CompressedTrace(const History<E>& hist) : periods(0), total(0), bucket_size(0) {
+                static_assert(std::is_enum<E>::value, "CompressedTrace encodes enum states");
+                for(auto& p : hist) {
+                    if(periods % INDEX_INTERVAL == 0)
+                        index.push_back({total, bytes.size()});
+                    encodePeriod(bytes, p.state, p.duration);
+                    total += p.duration;
+                    periods++;
+                }
+                bytes.shrink_to_fit();
+                if(periods >= LOD_MIN_PERIODS)
+                    buildPyramid();
+            }
+
+            uint64_t size() const {
+                return periods;
+            }
+            StepSum duration() const {
+                return total;
+            }
+            // bytes used by the encoded periods
+            std::size_t encodedBytes() const {
+                return bytes.size();
+            }
+            std::size_t levelCount() const {
+                return levels.size();
+            }
+
+            // calls f(Period) for every period overlapping [begin, end), seeking instead of decoding from the start
+            template<class F>
+            void forEach(StepSum begin, StepSum end, F f) const {
+                if(index.empty() || begin >= end)
+                    return;
+                // last checkpoint at or before begin
+                auto cp = std::upper_bound(index.begin(), index.end(), begin, [](StepSum b, const Checkpoint& c){ return b < c.start; });
+                if(cp != index.begin())
+                    cp--;
+                uint64_t pos = (*cp).offset;
+                StepSum at = (*cp).start;
+                while(pos < bytes.size() && at < end) {
+                    auto p = decode(pos);
+                    if(at + p.second > begin)
+                        f(Period{p.first, at, p.second});
+                    at += p.second;
+                }
+            }
+
+            // exact periods overlapping [begin, end)
+            std::vector<Period> decode(StepSum begin, StepSum end) const {
+                std::vector<Period> out;
+                forEach(begin, end, [&out](const Period& p){ out.push_back(p); });
+                return out;
+            }
+
+            History<E> toHistory() const {
+                History<E> out;
+                forEach(0, total, [&out](const Period& p){ out.push(p.state, p.duration); });
+                return out;
+            }
+
+            // at most about max_points buckets covering [begin, end)
+            // uses the finest pyramid level coarse enough, or exact periods when the range holds few enough of them
+            std::vector<Bucket> query(StepSum begin, StepSum end, std::size_t max_points) const {
+                std::vector<Bucket> out;
+                end = std::min(end, total);
+                if(begin >= end || max_points == 0)
+                    return out;
+                std::size_t lvl = 0;
+                while(lvl < levels.size() && (end - begin) / (bucket_size << lvl) > max_points)
+                    lvl++;
+                // exact periods if there is no pyramid, or if even level 0 is coarser than asked for
+                if(levels.empty() || (lvl == 0 && (end - begin) / bucket_size < max_points)) {
+                    std::vector<Period> ps = decode(begin, end);
+                    if(ps.size() <= max_points || levels.empty()) {
+                        for(auto& p : ps) {
+                            Bucket b = {p.start, p.duration, {}};
+                            b.mix[static_cast<std::size_t>(p.state)] = 255;
+                            out.push_back(b);
+                        }
+                        return out;
+                    }
+                }
+                lvl = std::min(lvl, levels.size() - 1);
+                StepSum size = bucket_size << lvl;
+                for(StepSum i = begin / size; i < levels[lvl].size() && i * size < end; i++)
+                    out.push_back({i * size, std::min(size, total - i * size), levels[lvl][i]});
+                return out;
+            }
+
+            // binary .trace format: "SIMT", version, header counts, encoded periods, seek index, pyramid
+            void write(std::ostream& out) const {
+                auto put = [&out](uint64_t v) { out.write(reinterpret_cast<const char*>(&v), sizeof(v)); };
+                out.write("SIMT", 4);
+                put(1);
+                put(periods);
+                put(total);
+                put(bucket_size);
+                put(bytes.size());
+                out.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+                put(index.size());
+                for(auto& c : index) {
+                    put(c.start);
+                    put(c.offset);
+                }
+                put(levels.size());
+                for(auto& l : levels) {
+                    put(l.size());
+                    for(auto& m : l)
+                        out.write(reinterpret_cast<const char*>(m.data()), MAX_STATES);
+                }
+            }
+
+            static CompressedTrace read(std::istream& in) {
+                auto get = [&in]() { uint64_t v = 0; in.read(reinterpret_cast<char*>(&v), sizeof(v)); return v; };
+                char magic[4];
+                in.read(magic, 4);
+                if(!in || std::string(magic, 4) != "SIMT" || get() != 1)
+                    throw std::string("Not a version 1 .trace stream");
+                CompressedTrace t;
+                t.periods = get();
+                t.total = get();
+                t.bucket_size = get();
+                t.bytes.resize(get());
+                in.read(reinterpret_cast<char*>(t.bytes.data()), t.bytes.size());
+                t.index.resize(get());
+                for(auto& c : t.index) {
+                    c.start = get();
+                    c.offset = get();
+                }
+                t.levels.resize(get());
+                for(auto& l : t.levels) {
+                    l.resize(get());
+                    for(auto& m : l)
+                        in.read(reinterpret_cast<char*>(m.data()), MAX_STATES);
+                }
+                return t;
+            }
+
+            // downsampled timeline as .csv (start,length,state plus the share of each state)
+            std::string to_timeline_csv(StepSum begin, StepSum end, std::size_t max_points) const {
+                std::ostringstream out_s;
+                out_s << "start,duration,state";
+                for(std::size_t i = 0; i < MAX_STATES; i++)
+                    if(!to_string(static_cast<E>(i)).empty())
+                        out_s << "," << to_string(static_cast<E>(i));
+                out_s << std::endl;
+                for(auto& b : query(begin, end, max_points)) {
+                    out_s << b.start << "," << b.length << "," << to_string(b.dominant());
+                    for(std::size_t i = 0; i < MAX_STATES; i++)
+                        if(!to_string(static_cast<E>(i)).empty())
+                            out_s << "," << b.mix[i] / 255.0;
+                    out_s << std::endl;
+                }
+                return out_s.str();
+            }
+    };
+
+    // writes every process and CPU timeline of a run as a .trace file
+    // (the compressed counterpart of the timelines folder written by SimulationStats::exportStats)
+    void exportCompressedTimelines(const SimulationStats& stats, std::string folder) {
+        std::string dir = folder + "/timelines/processes/compressed";
+        std::string cmd = "mkdir -p " + dir;
+        system(cmd.c_str());
+
+        std::string path;
+        int i = 0;
+        for(auto& p : stats.ps) {
+            path = dir + "/" + std::to_string(i++) + ".trace";
+            std::ofstream f(path, std::ofstream::out | std::ofstream::binary);
+            if(!f.is_open())
+                throw "Error opening file " + path;
+            CompressedTrace<ProcessState>(p.hist).write(f);
+        }
+
+        dir = folder + "/timelines/cpus/compressed";
+        cmd = "mkdir -p " + dir;
+        system(cmd.c_str());
+
+        i = 0;
+        for(auto& c : stats.cs) {
+            path = dir + "/" + std::to_string(i++) + ".trace";
+            std::ofstream f(path, std::ofstream::out | std::ofstream::binary);
+            if(!f.is_open())
+                throw "Error opening file " + path;
+            CompressedTrace<CPUState>(c.hist).write(f);
+        }
+    }
+
+    void exportCompressedTimelines(const ManyStats& stats) {
+        std::string folder = stats.getFolderName();
+        for(auto& run : stats.runs)
+            exportCompressedTimelines(run, folder + "/" + to_string(run.settings));
+    }
+}
+
+#endif
@@ -5,21 +5,149 @@
 
 #include <vector>
 #include <stdint.h>
+#include <type_traits>
+#include <cmath>
 #include <string>
 #include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <limits>
 
 namespace Simulation {
-    using Step = uint32_t;
-    using PID = uint16_t;
-    using Priority = uint8_t;
+    // the integral widths used by the simulation are bundled into a traits type
+    //  CompactTraits keeps PCBs, Timers and History periods small, which is what ordinary runs want
+    //  ScaleTraits lifts the 65,535 process cap and the 2^32 step horizon for very large or very long runs
+    struct CompactTraits {
+        using Step = uint32_t;
+        using PID = uint16_t;
+        using Priority = uint8_t;
+        static constexpr Priority MAX_PRIO = 7;
+    };
+    struct ScaleTraits {
+        using Step = uint64_t;
+        using PID = uint32_t;
+        using Priority = uint8_t;
+        static constexpr Priority MAX_PRIO = 7;
+    };
+
+    // the traits are picked at compile time (build with -DSIMULATION_SCALE for ScaleTraits)
+    //  so neither configuration pays for the other with runtime branches
+#ifdef SIMULATION_SCALE
+    using Traits = ScaleTraits;
+#else
+    using Traits = CompactTraits;
+#endif
+
+    using Step = Traits::Step;
+    using PID = Traits::PID;
+    using Priority = Traits::Priority;
     using CPUID = std::vector<Step>::size_type;
+    // sums of Steps across many processes/CPUs, which overflow a compact Step long before any single run does
+    using StepSum = uint64_t;
+
+    static_assert(std::is_unsigned<Step>::value && std::is_unsigned<PID>::value && std::is_unsigned<Priority>::value, "simulation traits must use unsigned types");
+    static_assert(sizeof(StepSum) >= sizeof(Step), "StepSum must be at least as wide as Step");
 
     const std::string DATA_DIR = "data";
-    const Priority MAX_PRIO = 7;
+    const Priority MAX_PRIO = Traits::MAX_PRIO;
     const unsigned int MAX_BURSTS = 20;
     const Step MAX_CPU_BURST = 200;
     const Step MAX_IO_BURST = 500;
     const Step ARRIVAL_MAX_PER_PROCESS = 50;
+    // wall-clock length of one Step, which turns watts into joules
+    const double STEP_SECONDS = 0.001;
+
+    // order in which an IODevice serves its waiting requests
+    enum class IODiscipline {fifo, sjf, priority};
+    std::string to_string(IODiscipline d) {
+        switch(d) {
+            case IODiscipline::fifo:
+                return "fifo";
+            case IODiscipline::sjf:
+                return "sjf";
+            case IODiscipline::priority:
+                return "priority";
+        }
+        return "";
+    }
+
+    // how a free CPU picks its next process
+    //      priority: the ReadyPriorityQueue (lowest Priority value first, FIFO within a level)
+    //      lottery: a random draw weighted by tickets
+    //      stride: the process with the lowest pass, which advances by (STRIDE1 / tickets) per step of CPU used
+    //      edf: the process with the earliest absolute deadline (processes without one come last, FIFO)
+    //      fair: hierarchical fair share, the groups of SystemSettings::GROUPS split the CPUs by weight, and the processes of a group by tickets
+    enum class Scheduler {priority, lottery, stride, edf, fair};
+    std::string to_string(Scheduler s) {
+        switch(s) {
+            case Scheduler::priority:
+                return "priority";
+            case Scheduler::lottery:
+                return "lottery";
+            case Scheduler::stride:
+                return "stride";
+            case Scheduler::edf:
+                return "edf";
+            case Scheduler::fair:
+                return "fair";
+        }
+        return "";
+    }
+
+    // an operating point of a CPU: speed in percent of the CPU's own speed (see SystemSettings::getCPUSpeed), and power while busy at it
+    struct PState {
+        unsigned speed;
+        double watts;
+    };
+    // power model of one CPU
+    //      busy (processing or switching) at the current P-state, idle at idle_watts
+    //      once idle for sleep_after steps the CPU sleeps at sleep_watts, and switching a process in on a sleeping CPU takes wake_latency longer
+    struct CPUPower {
+        std::vector<PState> pstates = {{50, 4}, {75, 7}, {100, 12}};    // ascending speed, the last is where the CPU starts (normally 100)
+        double idle_watts = 2;
+        double sleep_watts = 0.5;
+        Step sleep_after = 0;           // 0: never sleeps
+        Step wake_latency = 0;
+    };
+    std::string to_string(const CPUPower& p) {
+        std::ostringstream out;
+        for(std::size_t i = 0; i < p.pstates.size(); i++)
+            out << (i ? "-" : "") << p.pstates[i].speed << ":" << p.pstates[i].watts;
+        out << "i" << p.idle_watts;
+        if(p.sleep_after > 0)
+            out << "s" << p.sleep_watts << "a" << p.sleep_after << "w" << p.wake_latency;
+        return out.str();
+    }
+
+    // changes a CPU's P-state with its utilization
+    //      ondemand: every GOVERNOR_INTERVAL steps, jump to the fastest P-state above GOVERNOR_UP utilization, step down one below GOVERNOR_DOWN
+    enum class Governor {none, ondemand};
+    std::string to_string(Governor g) {
+        switch(g) {
+            case Governor::none:
+                return "none";
+            case Governor::ondemand:
+                return "ondemand";
+        }
+        return "";
+    }
+
+    // a scheduling group of Scheduler::fair, after a cgroup's cpu.weight and cpu.max
+    //      groups nest: parent is the index of an earlier group, or ROOT
+    //      siblings share their parent's CPU time in proportion to their weights
+    //      with a quota, the group (with its subgroups) runs at most quota CPU steps in every period steps, and is throttled for the rest of the period once it has
+    struct GroupSettings {
+        static constexpr std::size_t ROOT = std::numeric_limits<std::size_t>::max();
+        std::size_t parent = ROOT;
+        unsigned weight = 100;
+        Step quota = 0;             // 0: unlimited
+        Step period = 100;
+    };
+
+    struct IODeviceSettings {
+        unsigned channels = 1;      // requests served at once
+        IODiscipline discipline = IODiscipline::fifo;
+    };
 
     struct SystemSettings {
         CPUID CPU_COUNT = 4;
@@ -27,6 +155,40 @@ namespace Simulation {
         Step RR_TIME = 100;
         Step SWITCHING_IN_DELAY = 7;
         Step SWITCHING_OUT_DELAY = 3;
+        // switching in a process which was the last to run on this CPU (its cache is still warm)
+        Step SWITCHING_IN_WARM_DELAY = 7;
+        // switching in a process which last ran on a different CPU
+        Step SWITCHING_IN_MIGRATION_DELAY = 7;
+        // speed of each CPU in percent of the base speed (CPU i uses entry i, missing entries run at 100)
+        // a CPU at 200 finishes two steps of a CPU burst per Step, one at 50 finishes one every other Step
+        std::vector<unsigned> CPU_SPEEDS;
+        // when a CPU picks from the ready queue, prefer a process which last ran on it (within its priority level)
+        bool AFFINITY_DISPATCH = false;
+        // a process which becomes ready with a higher priority than a running process takes that process's CPU
+        // (the lowest-priority running process is the one preempted)
+        bool PREEMPTIVE = false;
+        // a ready process gains one priority level for every AGING_INTERVAL steps it waits (0 disables aging)
+        Step AGING_INTERVAL = 0;
+        // the proportional-share schedulers weight processes by their tickets and EDF orders them by deadline, rather than serving priorities in order
+        // (AFFINITY_DISPATCH, PREEMPTIVE and AGING_INTERVAL only apply to Scheduler::priority)
+        Scheduler SCHEDULER = Scheduler::priority;
+        // seed of Scheduler::lottery's draws (compareSettings and sweeps set it to each replication's workload seed)
+        uint64_t LOTTERY_SEED = 0;
+        // power model of each CPU (CPU i uses entry i, missing entries use the last, empty means every CPU uses CPUPower())
+        std::vector<CPUPower> CPU_POWER;
+        Governor GOVERNOR = Governor::none;
+        Step GOVERNOR_INTERVAL = 100;
+        double GOVERNOR_UP = 0.8;
+        double GOVERNOR_DOWN = 0.3;
+        // shared IO devices, a process always uses device (PID % count)
+        //      every IO burst is sent to the device, so under FCFS a process gives up its CPU at the end of each CPU burst
+        // empty means IO has unlimited bandwidth: every blocked process counts down in parallel
+        std::vector<IODeviceSettings> IO_DEVICES;
+        // the groups of Scheduler::fair, a process belongs to group ProcessInit::group, which must be a leaf
+        // empty means every process is in one group (so fair behaves as stride), the other schedulers ignore the groups
+        std::vector<GroupSettings> GROUPS;
+        // count the allocations of each part of the System and their peak (see MemoryFootprint), at the cost of a few additions per allocation
+        bool MEMORY_ACCOUNTING = false;
 
         void print(int indent = 0) const {
             std::string ind(indent, ' ');
@@ -36,6 +198,56 @@ namespace Simulation {
             std::cout << ind << "    RR Time:       " << RR_TIME << std::endl;
             std::cout << ind << "    Switching In:  " << SWITCHING_IN_DELAY << std::endl;
             std::cout << ind << "    Switching Out: " << SWITCHING_OUT_DELAY << std::endl;
+            if(SWITCHING_IN_WARM_DELAY != SWITCHING_IN_DELAY || SWITCHING_IN_MIGRATION_DELAY != SWITCHING_IN_DELAY) {
+                std::cout << ind << "    Switching In (warm):      " << SWITCHING_IN_WARM_DELAY << std::endl;
+                std::cout << ind << "    Switching In (migration): " << SWITCHING_IN_MIGRATION_DELAY << std::endl;
+            }
+            if(!CPU_SPEEDS.empty()) {
+                std::cout << ind << "    CPU Speeds:   ";
+                for(CPUID i = 0; i < CPU_COUNT; i++)
+                    std::cout << " " << getCPUSpeed(i) << "%";
+                std::cout << std::endl;
+            }
+            if(AFFINITY_DISPATCH)
+                std::cout << ind << "    Affinity Dispatch" << std::endl;
+            if(PREEMPTIVE)
+                std::cout << ind << "    Preemptive Priority" << std::endl;
+            if(AGING_INTERVAL > 0)
+                std::cout << ind << "    Aging Interval: " << AGING_INTERVAL << std::endl;
+            if(SCHEDULER != Scheduler::priority)
+                std::cout << ind << "    Scheduler:     " << to_string(SCHEDULER) << std::endl;
+            if(SCHEDULER == Scheduler::lottery && LOTTERY_SEED != 0)
+                std::cout << ind << "    Lottery Seed:  " << LOTTERY_SEED << std::endl;
+            for(std::size_t i = 0; i < CPU_POWER.size(); i++)
+                std::cout << ind << "    CPU Power:     " << i << (i + 1 == CPU_POWER.size() && i + 1 < CPU_COUNT ? "+ " : " ") << to_string(CPU_POWER[i]) << std::endl;
+            if(GOVERNOR != Governor::none)
+                std::cout << ind << "    Governor:      " << to_string(GOVERNOR) << " every " << GOVERNOR_INTERVAL << " (up " << GOVERNOR_UP << ", down " << GOVERNOR_DOWN << ")" << std::endl;
+            for(auto& d : IO_DEVICES)
+                std::cout << ind << "    IO Device:     " << d.channels << " channel(s), " << to_string(d.discipline) << std::endl;
+            for(std::size_t i = 0; i < GROUPS.size(); i++) {
+                std::cout << ind << "    Group:         " << i << " under " << (GROUPS[i].parent == GroupSettings::ROOT ? std::string("root") : std::to_string(GROUPS[i].parent)) << ", weight " << GROUPS[i].weight;
+                if(GROUPS[i].quota > 0)
+                    std::cout << ", quota " << GROUPS[i].quota << " per " << GROUPS[i].period;
+                std::cout << std::endl;
+            }
+            if(MEMORY_ACCOUNTING)
+                std::cout << ind << "    Memory Accounting" << std::endl;
+        }
+
+        unsigned getCPUSpeed(CPUID i) const {
+            return i < CPU_SPEEDS.size() ? CPU_SPEEDS[i] : 100;
+        }
+        CPUPower getCPUPower(CPUID i) const {
+            if(CPU_POWER.empty())
+                return CPUPower();
+            return CPU_POWER[std::min<std::size_t>(i, CPU_POWER.size() - 1)];
+        }
+
+        // big/little: the first big CPUs run at big_speed, the rest at little_speed
+        void bigLittle(CPUID big, unsigned big_speed = 100, unsigned little_speed = 50) {
+            CPU_SPEEDS.assign(CPU_COUNT, little_speed);
+            for(CPUID i = 0; i < big && i < CPU_COUNT; i++)
+                CPU_SPEEDS[i] = big_speed;
         }
 
         static SystemSettings fcfs() {
@@ -43,6 +255,18 @@ namespace Simulation {
             sett.RR_TIME = 0;
             return sett;
         }
+
+        // count equal groups under the root, each with the same quota, scheduled by Scheduler::fair
+        void tenants(std::size_t count, Step quota = 0, Step period = 100) {
+            SCHEDULER = Scheduler::fair;
+            GROUPS.assign(count, GroupSettings{GroupSettings::ROOT, 100, quota, period});
+        }
+
+        // switching costs which depend on where the incoming process last ran
+        void affinityCosts(Step warm, Step migration) {
+            SWITCHING_IN_WARM_DELAY = warm;
+            SWITCHING_IN_MIGRATION_DELAY = migration;
+        }
     };
     // takes in SystemSettings, returns vector of system settings with varying cpus
     //  increases cpu count logarithmically
@@ -55,15 +279,69 @@ namespace Simulation {
         }
         return out;
     }
-    std::string to_string(SystemSettings sett) {
-        return std::to_string(sett.CPU_COUNT)
+    std::string to_string(const SystemSettings& sett) {
+        std::string out = std::to_string(sett.CPU_COUNT)
          + "_" + std::to_string(sett.PROCESS_COUNT)
           + "_" + std::to_string(sett.RR_TIME)
            + "_" + std::to_string(sett.SWITCHING_IN_DELAY)
             + "_" + std::to_string(sett.SWITCHING_OUT_DELAY);
+        // optional settings are only named when used, so existing folder names stay the same
+        if(sett.SWITCHING_IN_WARM_DELAY != sett.SWITCHING_IN_DELAY || sett.SWITCHING_IN_MIGRATION_DELAY != sett.SWITCHING_IN_DELAY)
+            out += "_w" + std::to_string(sett.SWITCHING_IN_WARM_DELAY) + "m" + std::to_string(sett.SWITCHING_IN_MIGRATION_DELAY);
+        if(!sett.CPU_SPEEDS.empty()) {
+            // run-length encoded, e.g. _s100x2-50x6
+            out += "_s";
+            for(CPUID i = 0; i < sett.CPU_COUNT; ) {
+                CPUID j = i;
+                while(j < sett.CPU_COUNT && sett.getCPUSpeed(j) == sett.getCPUSpeed(i))
+                    j++;
+                out += (i ? "-" : "") + std::to_string(sett.getCPUSpeed(i)) + "x" + std::to_string(j - i);
+                i = j;
+            }
+        }
+        if(sett.AFFINITY_DISPATCH)
+            out += "_aff";
+        if(sett.PREEMPTIVE)
+            out += "_pre";
+        if(sett.AGING_INTERVAL > 0)
+            out += "_age" + std::to_string(sett.AGING_INTERVAL);
+        if(sett.SCHEDULER != Scheduler::priority)
+            out += "_" + to_string(sett.SCHEDULER);
+        if(sett.SCHEDULER == Scheduler::lottery && sett.LOTTERY_SEED != 0)
+            out += "_ls" + std::to_string(sett.LOTTERY_SEED);
+        for(auto& p : sett.CPU_POWER)
+            out += "_pw" + to_string(p);
+        if(sett.GOVERNOR != Governor::none) {
+            std::ostringstream gov;
+            gov << "_" << to_string(sett.GOVERNOR) << sett.GOVERNOR_INTERVAL << "u" << sett.GOVERNOR_UP << "d" << sett.GOVERNOR_DOWN;
+            out += gov.str();
+        }
+        for(auto& d : sett.IO_DEVICES)
+            out += "_io" + std::to_string(d.channels) + to_string(d.discipline);
+        if(!sett.GROUPS.empty()) {
+            // run-length encoded like the speeds, e.g. _grw100x64 for 64 groups of weight 100 under the root
+            auto name = [](const GroupSettings& g) {
+                std::string out = (g.parent == GroupSettings::ROOT ? std::string("r") : std::to_string(g.parent)) + "w" + std::to_string(g.weight);
+                if(g.quota > 0)
+                    out += "q" + std::to_string(g.quota) + "p" + std::to_string(g.period);
+                return out;
+            };
+            out += "_g";
+            for(std::size_t i = 0; i < sett.GROUPS.size(); ) {
+                std::size_t j = i;
+                while(j < sett.GROUPS.size() && name(sett.GROUPS[j]) == name(sett.GROUPS[i]))
+                    j++;
+                out += (i ? "-" : "") + name(sett.GROUPS[i]) + "x" + std::to_string(j - i);
+                i = j;
+            }
+        }
+        if(sett.MEMORY_ACCOUNTING)
+            out += "_mem";
+        return out;
     }
 
-    enum class ProcessState {ready, running, blocked, exit, switching};
+    // blocked: IO burst in progress, io_waiting: queued for a busy IO device
+    enum class ProcessState {ready, running, blocked, exit, switching, io_waiting};
     std::string to_string(ProcessState s) {
         switch(s) {
             case ProcessState::ready:
@@ -76,6 +354,8 @@ namespace Simulation {
                 return "exit";
             case ProcessState::switching:
                 return "switching";
+            case ProcessState::io_waiting:
+                return "io_waiting";
         }
         return "";
     }
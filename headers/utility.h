@@ -7,11 +7,30 @@
 #include <cassert>
 #include <vector>
 #include <queue>
+#include <list>
+#include <numeric>
+#include <memory_resource>
 
 namespace Simulation {
     // lower Priority value ===> higher priority
+    // with aging, an entry's effective priority improves by one level every aging_interval steps it has waited
+    //      equivalently, an entry of priority p ranks as if it had been pushed p*aging_interval steps later (a virtual time)
+    //      entries of a level are FIFO, so the front of each level has the earliest virtual time of its level
+    //      the top entry is then found by comparing the fronts alone (O(levels)), and nothing is updated per entry per step
     template<typename T>
     class ReadyPriorityQueue {
+        public:
+            struct Entry {
+                T val;
+                Step since;     // step the entry was pushed
+            };
+        private:
+            // each priority level is a FIFO list rather than a std::queue
+            //      an emptied list holds no memory (a deque always keeps a block), which lets the System release its memory resource in bulk between runs
+            //      iterating walks the lists in place instead of copying and popping every queue
+            // the vector itself stays on the heap, only the queue entries use the given resource
+            using queue_type = std::pmr::list<Entry>;
+            using queue_vector = std::vector<queue_type>;
         public:
             class const_iterator {
                 using iterator_category = std::forward_iterator_tag;
@@ -21,26 +40,33 @@ namespace Simulation {
                 using reference         = const T&;  // or also value_type&
 
                 private:
-                    const std::vector<std::queue<T>>* orig_q;
-                    std::vector<std::queue<T>> q;
-                    int prio;
+                    const queue_vector* orig_q;
+                    typename queue_vector::size_type prio;
+                    typename queue_type::const_iterator it;
+
+                    // skip forward to the first queue (from prio) with contents
+                    void settle() {
+                        while(prio < orig_q->size() && it == (*orig_q)[prio].cend())
+                            if(++prio < orig_q->size())
+                                it = (*orig_q)[prio].cbegin();
+                    }
                 public:
-                    const_iterator(const std::vector<std::queue<T>>& qq, int pp) : orig_q(&qq), q(qq), prio(pp) {}
+                    const_iterator(const queue_vector& qq, typename queue_vector::size_type pp) : orig_q(&qq), prio(pp) {
+                        if(prio < orig_q->size()) {
+                            it = (*orig_q)[prio].cbegin();
+                            settle();
+                        }
+                    }
 
-                    reference operator*() const { return q[prio].front(); }
+                    reference operator*() const { return (*it).val; }
+                    Priority priority() const { return prio; }
+                    Step since() const { return (*it).since; }
 
                     // Prefix increment
                     const_iterator& operator++() {
-                        // move to next element by deleting old element from container
-                        q[prio].pop();
-
-                        // if at end of current queue
-                        if(q[prio].empty()) {
-                            // find next queue with contents
-                            while(++prio < q.size())
-                                if(!(q[prio].empty()))
-                                    break;
-                        }
+                        ++it;
+                        // if at end of current queue, find next queue with contents
+                        settle();
                         return *this; 
                     }
                     // Postfix increment
@@ -48,31 +74,45 @@ namespace Simulation {
 
                     // comparison
                     friend bool operator== (const const_iterator& a, const const_iterator& b) { 
-                        return a.orig_q == b.orig_q && a.prio == b.prio;
+                        return a.orig_q == b.orig_q && a.prio == b.prio && (a.prio == a.orig_q->size() || a.it == b.it);
                     };
                     friend bool operator!= (const const_iterator& a, const const_iterator& b) { return !(a == b); }; 
             };
         private:
             // this schema relies on an implicit conversion from Priority to size_type
-            std::vector<std::queue<T>> queues;
+            queue_vector queues;
+            Step aging_interval;    // 0: strict priority
 
             // returns index of highest-priority 
-            typename std::vector<std::queue<T>>::size_type getTopQueueIndex() const {
-                for(typename std::vector<std::queue<T>>::size_type i = 0; i < queues.size(); i++)
-                    if(!queues[i].empty())
+            // with aging, the level whose front has the earliest virtual time (ties go to the higher base priority)
+            typename queue_vector::size_type getTopQueueIndex() const {
+                typename queue_vector::size_type best = queues.size();
+                StepSum best_time = 0;
+                for(typename queue_vector::size_type i = 0; i < queues.size(); i++) {
+                    if(queues[i].empty())
+                        continue;
+                    if(aging_interval == 0)
                         return i;
-                return queues.size();
+                    StepSum t = queues[i].front().since + StepSum(i) * aging_interval;
+                    if(best == queues.size() || t < best_time) {
+                        best = i;
+                        best_time = t;
+                    }
+                }
+                return best;
             }
         public:
-            ReadyPriorityQueue(Priority max = MAX_PRIO) : queues(max+1) {}
+            ReadyPriorityQueue(Priority max = MAX_PRIO, std::pmr::memory_resource* mem = std::pmr::get_default_resource()) : aging_interval(0) {
+                for(int i = 0; i <= max; i++)
+                    queues.emplace_back(mem);
+            }
 
             bool empty() const {
                 return getTopQueueIndex() == queues.size();
             }
             void clear() {
                 for(auto& q : queues)
-                    while(!q.empty())
-                        q.pop();
+                    q.clear();
             }
             typename ReadyPriorityQueue<T>::const_iterator begin() const {
                 return ReadyPriorityQueue<T>::const_iterator(queues, getTopQueueIndex());
@@ -81,29 +121,113 @@ namespace Simulation {
                 return ReadyPriorityQueue<T>::const_iterator(queues, queues.size());
             }
 
+            // calls f(T) for every entry, level by level (unlike begin(), which starts at the top level, this includes levels above an aged one)
+            template<class F>
+            void forEach(F f) const {
+                for(auto& q : queues)
+                    for(auto& e : q)
+                        f(e.val);
+            }
+
+            // calls f(T, base priority, since) for entries in the order take() would remove them, until f returns false
+            //      with aging, the levels are merged by virtual time (O(levels) per entry), so an aged entry comes up in its turn
+            //      whatever its level, and the entries come in order of effective priority
+            template<class F>
+            void forEachOrdered(F f) const {
+                if(aging_interval == 0) {
+                    for(typename queue_vector::size_type i = 0; i < queues.size(); i++)
+                        for(auto& e : queues[i])
+                            if(!f(e.val, Priority(i), e.since))
+                                return;
+                    return;
+                }
+                std::vector<typename queue_type::const_iterator> at;
+                for(auto& q : queues)
+                    at.push_back(q.cbegin());
+                while(true) {
+                    typename queue_vector::size_type best = queues.size();
+                    StepSum best_time = 0;
+                    for(typename queue_vector::size_type i = 0; i < queues.size(); i++) {
+                        if(at[i] == queues[i].cend())
+                            continue;
+                        StepSum t = (*at[i]).since + StepSum(i) * aging_interval;
+                        if(best == queues.size() || t < best_time) {
+                            best = i;
+                            best_time = t;
+                        }
+                    }
+                    if(best == queues.size() || !f((*at[best]).val, Priority(best), (*at[best]).since))
+                        return;
+                    ++at[best];
+                }
+            }
+
+            // 0 turns aging off
+            void setAging(Step interval) {
+                aging_interval = interval;
+            }
+            // priority p after waiting since a step, as of now (never better than 0)
+            Priority effectivePriority(Priority p, Step since, Step now) const {
+                if(aging_interval == 0 || now <= since)
+                    return p;
+                StepSum boost = (now - since) / aging_interval;
+                return boost >= p ? 0 : p - boost;
+            }
+
             Priority getMaxPriority() const {
                 return queues.size()-1;
             }
+            // base priority of front() (only meaningful if not empty)
+            Priority topPriority() const {
+                return getTopQueueIndex();
+            }
 
-            typename std::queue<T>::size_type size() const {
-                typename std::queue<T>::size_type init;
+            typename queue_type::size_type size() const {
+                typename queue_type::size_type init = 0;
                 return std::accumulate(
                     queues.begin(), 
                     queues.end(), 
                     init, 
-                    [](typename std::queue<T>::size_type i, std::queue<T> q){ return i + q.size(); });
+                    [](typename queue_type::size_type i, const queue_type& q){ return i + q.size(); });
             }
 
-            void push(T val, Priority p) {
-                queues.at(p).push(val);
+            void push(T val, Priority p, Step since = 0) {
+                queues.at(p).push_back({val, since});
             }
 
             const T& front() const {
-                return queues.at(getTopQueueIndex()).front();
+                return queues.at(getTopQueueIndex()).front().val;
             }
 
             void pop() {
-                return queues.at(getTopQueueIndex()).pop();
+                queues.at(getTopQueueIndex()).pop_front();
+            }
+
+            // removes and returns the top entry
+            Entry take() {
+                auto& q = queues.at(getTopQueueIndex());
+                Entry e = q.front();
+                q.pop_front();
+                return e;
+            }
+
+            // removes and returns the first of the first window entries of the highest-priority queue which satisfies pred
+            // falls back to front() if none do, so priority order is never broken
+            // with aging, an entry may only overtake the front by less than one aging_interval, or the front could starve
+            template<class Pred>
+            Entry popPreferred(Pred pred, std::size_t window) {
+                auto& q = queues.at(getTopQueueIndex());
+                auto it = q.begin();
+                for(std::size_t i = 0; i < window && it != q.end(); i++, it++) {
+                    if(aging_interval > 0 && (*it).since - q.front().since >= aging_interval)
+                        break;
+                    if(pred((*it).val)) {
+                        Entry e = *it;
+                        q.erase(it);
+                        return e;
+                    }
+                }
+                return take();
             }
     };
 
@@ -0,0 +1,308 @@
+// defines how processes are generated: random process bodies, closed batches of plans and open arrival processes
+
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include "typedefs.h"
+#include "process_utils.h"
+#include <vector>
+#include <list>
+#include <string>
+#include <fstream>
+#include <random>
+#include <limits>
+#include <cmath>
+#include <algorithm>
+#include <cstdlib>
+#include <stdint.h>
+
+namespace Simulation {
+    // random sources used to generate process bodies
+    // each provides below(n), a uniformly random value in [0, n)
+
+    // the global rand() stream (seeded by srand), which the original batch generator has always used
+    struct LegacyRandom {
+        unsigned long below(unsigned long n) {
+            return rand() % n;
+        }
+    };
+
+    // a self-contained, seeded stream, so a workload can be reproduced without touching global state
+    class SeededRandom {
+        private:
+            std::mt19937_64 gen;
+        public:
+            SeededRandom(uint64_t seed = 0) : gen(seed) {}
+
+            unsigned long below(unsigned long n) {
+                return gen() % n;
+            }
+            // uniformly random double in [0, 1)
+            double uniform() {
+                return std::generate_canonical<double, 53>(gen);
+            }
+            std::mt19937_64& engine() {
+                return gen;
+            }
+    };
+
+    // a SeededRandom whose draws can be mirrored (x becomes n-1-x)
+    //      a workload drawn mirrored is the antithetic twin of the plain one: draws at the same position mirror each other,
+    //      so late arrivals become early ones, high priorities low ones and many bursts few
+    //      the bursts themselves are not mirrored one for one: the first burst type flips, so the k-th burst of the twin is drawn
+    //      against the other type's maximum (and the twin has a different number of them), only the total work tends the other way
+    class AntitheticRandom {
+        private:
+            SeededRandom rng;
+            bool mirror;
+        public:
+            AntitheticRandom(uint64_t seed, bool mm) : rng(seed), mirror(mm) {}
+
+            unsigned long below(unsigned long n) {
+                unsigned long x = rng.below(n);
+                return mirror ? n - 1 - x : x;
+            }
+    };
+
+    // uniformly random Step in [0, bound)
+    // rand() alone only reaches RAND_MAX, which is too narrow for the arrival window of a large run
+    Step randomStep(Step bound) {
+        StepSum r = rand();
+        StepSum range = StepSum(RAND_MAX) + 1;
+        // widen one rand() at a time until the range covers bound
+        while(range < bound && range <= std::numeric_limits<StepSum>::max() / (StepSum(RAND_MAX) + 1)) {
+            r = r * (StepSum(RAND_MAX) + 1) + rand();
+            range *= StepSum(RAND_MAX) + 1;
+        }
+        return r % bound;
+    }
+
+    // generates burst_count random bursts, alternating from the type after proc_orig
+    template<class Source>
+    ProcessBursts generateBursts(int burst_count, bool proc_orig, Source& src) {
+        std::list<Step> raw_bursts;
+        bool proc = proc_orig;
+        for(int b = 0; b < burst_count; b++)
+            raw_bursts.push_back( src.below((proc = !proc) ? MAX_IO_BURST : MAX_CPU_BURST) + 1);
+        return ProcessBursts(raw_bursts.begin(), raw_bursts.end(), proc_orig);
+    }
+
+    // generates the bursts and priority of a single process
+    template<class Source>
+    ProcessInit generateProcess(PID id, Source& src) {
+        int burst_count = src.below(MAX_BURSTS) + 1;
+        bool proc_orig = src.below(2);
+        ProcessBursts bursts = generateBursts(burst_count, proc_orig, src);
+        // generate random prio
+        Priority p = src.below(MAX_PRIO);
+        return {id, p, bursts};
+    }
+
+    // a closed batch: n processes which all arrive within the first n*ARRIVAL_MAX_PER_PROCESS steps
+    std::vector<ProcessPlan> generateDataFiles(PID n) {
+        std::vector<ProcessPlan> out;
+        out.reserve(n);
+        LegacyRandom src;
+        for(PID i = 0; i < n; i++) {
+            ProcessInit init = generateProcess(i, src);
+            // generate random arrival time
+            Step arr = randomStep(Step(n) * ARRIVAL_MAX_PER_PROCESS) + 1;
+            ProcessPlan pl = {arr, init};
+            out.push_back(pl);
+        }
+        return out;
+    }
+
+    // a closed batch like the one above, but drawn from seed instead of rand() (antithetic draws it mirrored)
+    //      every process draws from its own substream, so process i gets the same (or mirrored) draws in every workload of this seed
+    //      however many draws the processes before it took
+    std::vector<ProcessPlan> generateDataFiles(PID n, uint64_t seed, bool antithetic = false) {
+        std::vector<ProcessPlan> out;
+        out.reserve(n);
+        for(PID i = 0; i < n; i++) {
+            AntitheticRandom src(splitmix64(seed ^ splitmix64(i)), antithetic);
+            // everything but the bursts first, so each always comes from the same draw as in the mirrored twin
+            //      (generateProcess draws the priority after the bursts, whose number differs between the twins)
+            Step arr = src.below(Step(n) * ARRIVAL_MAX_PER_PROCESS) + 1;
+            int burst_count = src.below(MAX_BURSTS) + 1;
+            bool proc = src.below(2);
+            Priority p = src.below(MAX_PRIO);
+            out.push_back({arr, {i, p, generateBursts(burst_count, proc, src)}});
+        }
+        return out;
+    }
+
+    // a process whose bursts are drawn as it runs (count of them, BurstGenerator::UNLIMITED for an endless one)
+    // an endless process never finishes, so a run holding one has to be driven to a horizon with System::load and System::tick
+    ProcessInit generateLazyProcess(PID id, Priority p, uint64_t seed, uint64_t count = BurstGenerator::UNLIMITED, bool proc = true) {
+        return {id, p, ProcessBursts(BurstGenerator(seed, count), proc)};
+    }
+
+    // a closed batch drawn like generateDataFiles(n, seed), but lazily: each plan holds one burst and a generator, never its whole body
+    //      the arrival, burst count, first burst type and priority are the same draws, the bursts themselves come from a separate stream
+    std::vector<ProcessPlan> generateLazyDataFiles(PID n, uint64_t seed) {
+        std::vector<ProcessPlan> out;
+        out.reserve(n);
+        for(PID i = 0; i < n; i++) {
+            SeededRandom src(splitmix64(seed ^ splitmix64(i)));
+            Step arr = src.below(Step(n) * ARRIVAL_MAX_PER_PROCESS) + 1;
+            uint64_t count = src.below(MAX_BURSTS) + 1;
+            bool proc = src.below(2);
+            Priority p = src.below(MAX_PRIO);
+            out.push_back({arr, generateLazyProcess(i, p, splitmix64(src.engine()()), count, proc)});
+        }
+        return out;
+    }
+
+    // expands every periodic task (init.period > 0 with releases > 1) into its jobs, in plan order
+    //  the first job keeps the task's PID, later jobs take PIDs above the highest in plans
+    //  throws if the jobs run out of PIDs
+    std::vector<ProcessPlan> releaseJobs(const std::vector<ProcessPlan>& plans) {
+        uint64_t next = 0;
+        for(auto& pl : plans)
+            next = std::max<uint64_t>(next, uint64_t(pl.init.id) + 1);
+        std::vector<ProcessPlan> out;
+        out.reserve(plans.size());
+        for(auto& pl : plans) {
+            out.push_back(pl);
+            out.back().releases = 1;
+            if(pl.init.period == 0)
+                continue;
+            for(unsigned k = 1; k < pl.releases; k++) {
+                out.push_back(out.back());
+                out.back().arrival += pl.init.period;
+                if(next > std::numeric_limits<PID>::max())
+                    throw "PID space exhausted releasing job " + std::to_string(k) + " of process " + std::to_string(pl.init.id) + ", build with SIMULATION_SCALE";
+                out.back().init.id = PID(next++);
+            }
+        }
+        return out;
+    }
+
+    // gives every process a relative deadline of slack times its total length (CPU and IO)
+    void assignDeadlines(std::vector<ProcessPlan>& plans, double slack) {
+        for(auto& pl : plans) {
+            StepSum length = 0;
+            for(auto it = pl.init.bursts.cbegin(); it != pl.init.bursts.cend(); it++)
+                length += *it;
+            double d = std::max(1.0, std::round(length * slack));
+            pl.init.deadline = d >= std::numeric_limits<Step>::max() ? std::numeric_limits<Step>::max() : (Step)(d);
+        }
+    }
+
+    // deals the processes out to the leaf groups of groups (see SystemSettings::GROUPS) in plan order, one each in turn
+    void assignGroups(std::vector<ProcessPlan>& plans, const std::vector<GroupSettings>& groups) {
+        std::vector<bool> leaf(groups.size(), true);
+        for(auto& g : groups)
+            if(g.parent != GroupSettings::ROOT)
+                leaf.at(g.parent) = false;
+        std::vector<std::size_t> leaves;
+        for(std::size_t i = 0; i < groups.size(); i++)
+            if(leaf[i])
+                leaves.push_back(i);
+        for(std::size_t i = 0; i < plans.size() && !leaves.empty(); i++)
+            plans[i].init.group = leaves[i % leaves.size()];
+    }
+
+    // an open stream of arrivals, used by System::simulateOpen
+    // next() returns the number of steps from the previous arrival to the next one (0 means simultaneous)
+    class ArrivalProcess {
+        public:
+            virtual ~ArrivalProcess() {}
+            virtual Step next() = 0;
+            // true once the process will produce no more arrivals
+            virtual bool done() const {
+                return false;
+            }
+    };
+
+    // memoryless arrivals at a mean rate (processes per step)
+    // a continuous clock is kept so rounding gaps to whole steps does not bias the rate
+    class PoissonArrivals : public ArrivalProcess {
+        private:
+            SeededRandom rng;
+            std::exponential_distribution<double> gap;
+            double clock;
+        public:
+            PoissonArrivals(double rate, uint64_t seed = 0) : rng(seed), gap(rate), clock(0) {}
+
+            Step next() override {
+                double prev = clock;
+                clock += gap(rng.engine());
+                return Step(std::floor(clock)) - Step(std::floor(prev));
+            }
+    };
+
+    // on/off bursts (a two-state Markov-modulated Poisson process)
+    // arrivals come at on_rate for exponentially distributed periods of mean_on steps, then at off_rate for periods of mean_off steps
+    class BurstyArrivals : public ArrivalProcess {
+        private:
+            SeededRandom rng;
+            double rates[2];
+            double mean_period[2];
+            bool on;
+            double clock;
+            double period_end;
+
+            double draw(double mean) {
+                return std::exponential_distribution<double>(1.0 / mean)(rng.engine());
+            }
+        public:
+            BurstyArrivals(double on_rate, double off_rate, double mean_on, double mean_off, uint64_t seed = 0) :
+                rng(seed), rates{off_rate, on_rate}, mean_period{mean_off, mean_on}, on(true), clock(0) {
+                period_end = draw(mean_on);
+            }
+
+            Step next() override {
+                double prev = clock;
+                while(true) {
+                    // a zero rate simply waits out the period
+                    double g = rates[on] > 0 ? std::exponential_distribution<double>(rates[on])(rng.engine()) : std::numeric_limits<double>::infinity();
+                    if(clock + g < period_end) {
+                        clock += g;
+                        break;
+                    }
+                    // memoryless, so the remainder of the gap can be redrawn in the next period
+                    clock = period_end;
+                    on = !on;
+                    period_end = clock + draw(mean_period[on]);
+                }
+                return Step(std::floor(clock)) - Step(std::floor(prev));
+            }
+    };
+
+    // replays recorded arrival steps (ascending)
+    class TraceArrivals : public ArrivalProcess {
+        private:
+            std::vector<Step> times;
+            typename std::vector<Step>::size_type pos;
+            Step last;
+        public:
+            TraceArrivals(std::vector<Step> tt) : times(tt), pos(0), last(0) {}
+
+            // one arrival step per line
+            static TraceArrivals fromFile(std::string path) {
+                std::ifstream f(path);
+                if(!f.is_open())
+                    throw "Error opening file " + path;
+                std::vector<Step> tt;
+                Step t;
+                while(f >> t)
+                    tt.push_back(t);
+                return TraceArrivals(tt);
+            }
+
+            Step next() override {
+                if(done())
+                    return std::numeric_limits<Step>::max();
+                Step gap = times[pos] - last;
+                last = times[pos++];
+                return gap;
+            }
+            bool done() const override {
+                return pos == times.size();
+            }
+    };
+}
+
+#endif
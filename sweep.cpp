@@ -0,0 +1,50 @@
+#include "headers/benchmark.h"
+#include "headers/sweep.h"
+#include <iostream>
+#include <string>
+#include <cstdlib>
+
+using namespace Simulation;
+
+// usage:
+//      sweep <spec>                run every job of the sweep, then merge
+//      sweep <spec> --shard i/n    run the jobs of shard i of n
+//      sweep <spec> --merge n      join the results of n shards into results.simr and summary.csv
+int main(int argc, char** argv) {
+    if(argc != 2 && argc != 4) {
+        std::cerr << "usage: " << argv[0] << " <spec> [--shard i/n | --merge n]" << std::endl;
+        return 1;
+    }
+    try {
+        SweepSpec spec = SweepSpec::fromFile(argv[1]);
+        if(argc == 2) {
+            runShard(spec, 0, 1);
+            mergeShards(spec, 1);
+        } else if(std::string(argv[2]) == "--shard") {
+            std::string arg = argv[3];
+            auto slash = arg.find('/');
+            if(slash == std::string::npos)
+                throw "--shard takes i/n";
+            std::size_t shard = std::stoul(arg.substr(0, slash));
+            std::size_t count = std::stoul(arg.substr(slash + 1));
+            runShard(spec, shard, count);
+            std::cout << "shard " << shard << "/" << count << ": " << spec.jobs(shard, count).size() << " of " << spec.jobCount() << " jobs -> " << spec.getShardPath(shard, count) << std::endl;
+            return 0;
+        } else if(std::string(argv[2]) == "--merge") {
+            mergeShards(spec, std::stoul(argv[3]));
+        } else {
+            std::cerr << "unknown option " << argv[2] << std::endl;
+            return 1;
+        }
+        std::cout << spec.jobCount() << " jobs -> " << spec.getFolderName() << "/summary.csv" << std::endl;
+    } catch(std::string e) {
+        std::cerr << e << std::endl;
+        return 1;
+    } catch(const char* e) {
+        std::cerr << e << std::endl;
+        return 1;
+    } catch(const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}